@@ -0,0 +1,66 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to sequence two drives on the same line without blocking:
+    the spindle is started and, once it's at speed, the pump is started.
+    Meanwhile loop() keeps blinking the led, never waiting for the drives.
+    This example uses an arduino MEGA board (multiple serial).
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+    Spindle has address 10, pump has address 11 (param P03.01).
+*/
+#include <VFDTask.h>
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFDBus bus(Serial2, 38400, comm_pin);
+VFD spindle(10, bus);  // drives on the bus share its line
+VFD pump(11, bus);
+
+VFD_Transaction t;  // a task needs a transaction for each request it waits at the same time
+VFD_Task start_sequence;
+
+// runs until both drives are running, see VFDTask.h
+bool startSequence() {
+  VFD_TASK_BEGIN(start_sequence);
+  VFD_TASK_RUN(start_sequence, bus.write(t, spindle, VFD_REGISTER_FREQUENCY, 2000), t); // 200.0Hz
+  VFD_TASK_RUN(start_sequence, bus.write(t, spindle, VFD_REGISTER_COMMAND, VFD_COMMAND_START_FORWARD), t);
+  VFD_TASK_WAIT_AT_SPEED(start_sequence, bus, t, spindle);
+  if(t.error != VFD_COMM_SUCCESS) {
+    Serial.println("Spindle not answering, pump not started");
+  }
+  else {
+    VFD_TASK_RUN(start_sequence, bus.write(t, pump, VFD_REGISTER_COMMAND, VFD_COMMAND_START), t);
+    if(t.error != VFD_COMM_SUCCESS) Serial.println("Spindle at speed, pump not answering");
+    else Serial.println("Spindle at speed, pump started");
+  }
+  VFD_TASK_END(start_sequence);
+}
+
+
+bool started = false;
+
+void setup() {
+  Serial.begin(9600);
+  Serial2.begin(38400, SERIAL_8O1);
+  pinMode(LED_BUILTIN, OUTPUT);
+  bus.begin();
+}
+
+void loop() {
+  bus.poll(); // runs the transactions, returns immediately
+
+  if(!started) started = startSequence();
+
+  digitalWrite(LED_BUILTIN, (millis() / 500) % 2); // never stops blinking
+}
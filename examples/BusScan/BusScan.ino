@@ -0,0 +1,62 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to find address (P03.01) and baud (P03.00) of the drives on a RS485 line.
+    This example uses an arduino MEGA board (multiple serial).
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+*/
+#include <YL620-Arduino.h>
+#include <VFDScanner.h>
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFDScanner scanner(Serial2, comm_pin);
+
+// called by the scanner to try every baud of the YL-620 table
+// the data format must match parameter P03.02 (here SERIAL_8O1)
+void setBaud(uint32_t baud) {
+  Serial2.begin(baud, SERIAL_8O1);
+}
+
+
+void setup() {
+  Serial.begin(9600);
+  scanner.begin();
+
+  Serial.println("Scanning...");
+  unsigned long started = millis();
+
+  VFD_Discovered found[16];
+  uint8_t num_found = scanner.scanAllBauds(setBaud, found, 16);
+
+  Serial.print("Found ");
+  Serial.print(num_found);
+  Serial.print(" drives in ");
+  Serial.print(millis() - started);
+  Serial.println("ms");
+
+  for(uint8_t i = 0; i < num_found; i++) {
+    Serial.print("Address ");
+    Serial.print(found[i].address);
+    Serial.print(" baud ");
+    Serial.print(found[i].baud);
+    Serial.print(" cpu id ");
+    Serial.println(found[i].cpu_id, HEX);
+  }
+}
+
+void loop() {
+  // nothing to do here
+
+}
@@ -0,0 +1,75 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how many drives fit on a board: the drives of a line share its settings,
+    each VFD object only holds the state of its drive. It prints the RAM taken by each object,
+    then keeps updating the drives one after the other.
+    This example uses an arduino MEGA board (multiple serial).
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+    Drives at addresses 1 to NUM_DRIVES (P03.01), 38400 baud (P03.00).
+*/
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+
+#define NUM_DRIVES 32
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFDBus bus(Serial2, 38400, comm_pin);
+
+// a VFD can't be built without its address: fill the array one by one
+VFD drives[NUM_DRIVES] = {
+  VFD(1, bus), VFD(2, bus), VFD(3, bus), VFD(4, bus), VFD(5, bus), VFD(6, bus), VFD(7, bus), VFD(8, bus),
+  VFD(9, bus), VFD(10, bus), VFD(11, bus), VFD(12, bus), VFD(13, bus), VFD(14, bus), VFD(15, bus), VFD(16, bus),
+  VFD(17, bus), VFD(18, bus), VFD(19, bus), VFD(20, bus), VFD(21, bus), VFD(22, bus), VFD(23, bus), VFD(24, bus),
+  VFD(25, bus), VFD(26, bus), VFD(27, bus), VFD(28, bus), VFD(29, bus), VFD(30, bus), VFD(31, bus), VFD(32, bus),
+};
+
+VFD_Transaction t;
+uint8_t next_drive = 0;
+
+
+void setup() {
+  Serial.begin(9600);
+  Serial2.begin(38400, SERIAL_8O1);
+  bus.begin();
+
+  Serial.print("VFD: ");
+  Serial.print(sizeof(VFD));
+  Serial.print(" bytes, ");
+  Serial.print(NUM_DRIVES);
+  Serial.print(" drives: ");
+  Serial.print(sizeof(drives));
+  Serial.println(" bytes");
+  Serial.print("VFDBus (line settings and frame buffer, shared): ");
+  Serial.print(sizeof(VFDBus));
+  Serial.println(" bytes");
+}
+
+
+void loop() {
+  bus.poll();
+  if(t.state == VFD_TRANSACTION_QUEUED || t.state == VFD_TRANSACTION_SENT) return;
+
+  if(VFDBus::done(t)) {
+    if(t.error != VFD_COMM_SUCCESS) {
+      Serial.print("Drive ");
+      Serial.print(next_drive + 1);
+      Serial.print(": ");
+      Serial.println(drives[next_drive].lastCommError());
+    }
+    next_drive = (next_drive + 1) % NUM_DRIVES;
+  }
+  bus.update(t, drives[next_drive]);
+}
@@ -0,0 +1,170 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example is a load test of a line without any drive connected: 32 simulated drives at
+    115200 baud, polled by VFDScheduler, half of them running. The simulated line corrupts and
+    drops 1% of the answers, and a drive goes offline for a second. At the end it prints the
+    throughput, the latency of the updates, the errors and how long the offline drive took to
+    be updated again once back.
+
+    Build flags (for the whole library, es. build_flags in platformio.ini):
+    -DVFD_SCHED_MAX_DRIVES=32 to poll all the drives
+    -DVFD_VIRTUAL_TIME to run in virtual time: deterministic and much faster than real time.
+    Without it the simulation runs in real time on the board.
+*/
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#include <VFDScheduler.h>
+#include <VFDSim.h>
+
+#define NUM_DRIVES 32
+#define BAUD 115200
+#define RUN_TIME 10000  // ms of simulated time
+#define OFFLINE_DRIVE 5 // address of the drive going offline
+#define OFFLINE_FROM 3000 // ms from the start
+#define OFFLINE_TO 4000
+
+VFD_SimDrive sim_drives[NUM_DRIVES];
+VFDSimLine line(BAUD, sim_drives, NUM_DRIVES);
+VFDBus bus(line, BAUD);
+VFDScheduler scheduler(bus);
+
+// a VFD can't be built without its address: fill the array one by one
+VFD drives[NUM_DRIVES] = {
+  VFD(1, bus), VFD(2, bus), VFD(3, bus), VFD(4, bus), VFD(5, bus), VFD(6, bus), VFD(7, bus), VFD(8, bus),
+  VFD(9, bus), VFD(10, bus), VFD(11, bus), VFD(12, bus), VFD(13, bus), VFD(14, bus), VFD(15, bus), VFD(16, bus),
+  VFD(17, bus), VFD(18, bus), VFD(19, bus), VFD(20, bus), VFD(21, bus), VFD(22, bus), VFD(23, bus), VFD(24, bus),
+  VFD(25, bus), VFD(26, bus), VFD(27, bus), VFD(28, bus), VFD(29, bus), VFD(30, bus), VFD(31, bus), VFD(32, bus),
+};
+
+uint8_t num_polled = 0;
+uint32_t last_done[NUM_DRIVES]; // done_us of the last update counted
+uint32_t started;
+bool reported = false;
+
+uint32_t updates = 0;
+uint32_t failures = 0;
+uint32_t latency_sum = 0;
+uint32_t latency_max = 0;
+uint32_t back_online = 0; // micros() the offline drive came back at
+uint32_t recovery = 0;
+
+
+void setup() {
+  Serial.begin(9600);
+  bus.begin();
+  line.setSeed(42);
+
+  // start half of the drives, the scheduler updates them more often
+  for(uint8_t i = 0; i < NUM_DRIVES; i += 2) {
+    drives[i].setSpeedDeciHz(500);
+    drives[i].runForward();
+  }
+
+  for(uint8_t i = 0; i < NUM_DRIVES; i++) {
+    if(scheduler.addDrive(drives[i], 0) < 0) break;
+    last_done[i] = 0;
+    num_polled++;
+  }
+  if(num_polled < NUM_DRIVES) {
+    Serial.print("Polling ");
+    Serial.print(num_polled);
+    Serial.println(" drives, raise VFD_SCHED_MAX_DRIVES");
+  }
+
+  line.setFaults(10, 10);
+  line.resetStats();
+  started = VFD_MILLIS();
+}
+
+
+void loop() {
+  uint32_t elapsed = VFD_MILLIS() - started;
+  if(elapsed >= RUN_TIME) {
+    if(!reported) report();
+    reported = true;
+    return;
+  }
+
+  VFD_SimDrive& offline = sim_drives[OFFLINE_DRIVE-1];
+  bool online = elapsed < OFFLINE_FROM || elapsed >= OFFLINE_TO;
+  if(online && !offline.online) back_online = VFD_MICROS();
+  offline.online = online;
+
+  scheduler.poll();
+  bus.poll();
+
+  for(uint8_t i = 0; i < num_polled; i++) {
+    const VFD_Transaction& t = scheduler.getTransaction(i);
+    if(!VFDBus::done(t) || t.done_us == last_done[i]) continue;
+    last_done[i] = t.done_us;
+
+    if(t.error != VFD_COMM_SUCCESS) {
+      failures++;
+      continue;
+    }
+    updates++;
+    uint32_t latency = t.done_us - t.sent_us;
+    latency_sum += latency;
+    if(latency > latency_max) latency_max = latency;
+    if(i == OFFLINE_DRIVE-1 && back_online != 0 && recovery == 0) recovery = t.done_us - back_online;
+  }
+}
+
+
+void report() {
+  Serial.print("Simulated ");
+  Serial.print(RUN_TIME);
+  Serial.print(" ms in ");
+  Serial.print(millis());
+  Serial.println(" ms");
+
+  Serial.print("Throughput: ");
+  Serial.print(updates * 1000UL / RUN_TIME);
+  Serial.print(" updates/s (max ");
+  Serial.print(scheduler.getMaxRate());
+  Serial.println(")");
+
+  Serial.print("Latency: avg ");
+  Serial.print(updates > 0 ? latency_sum / updates : 0);
+  Serial.print(" us, max ");
+  Serial.print(latency_max);
+  Serial.println(" us");
+
+  Serial.print("Update interval: running ");
+  Serial.print(scheduler.getAchievedInterval(0));
+  Serial.print(" ms, stopped ");
+  Serial.print(scheduler.getAchievedInterval(1));
+  Serial.println(" ms");
+
+  Serial.print("Failed updates: ");
+  Serial.print(failures);
+  Serial.print(" (corrupted ");
+  Serial.print(line.corruptedCount());
+  Serial.print(", dropped ");
+  Serial.print(line.droppedCount());
+  Serial.print(", collisions ");
+  Serial.print(line.collisionCount());
+  Serial.println(")");
+
+  Serial.print("Line utilization: ");
+  Serial.print(line.getUtilization());
+  Serial.println("%");
+
+  Serial.print("Drive ");
+  Serial.print(OFFLINE_DRIVE);
+  Serial.print(" updated again ");
+  Serial.print(recovery);
+  Serial.println(" us after coming back");
+}
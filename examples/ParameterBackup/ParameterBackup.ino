@@ -0,0 +1,81 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to backup the VFD parameters to an image and restore them later.
+    This example uses an arduino MEGA board (multiple serial).
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+
+    Only the parameters that differ from the image are written back on restore,
+    so restoring an image on the same drive it was dumped from writes nothing.
+*/
+#include <YL620-Arduino.h>
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFD inverter(10, Serial2, 38400, comm_pin);
+
+/*
+  Ranges of parameters to backup, as {section, first parameter, number of parameters}.
+  Each range is read with as few requests as possible, instead of one request per parameter.
+*/
+const VFD_ParamRange ranges[] = {
+  {0, 0, 10}, // P00.00 - P00.09
+  {3, 0, 3},  // P03.00 - P03.02 (communication settings)
+  {7, 0, 10}, // P07.00 - P07.09
+};
+const uint8_t num_ranges = sizeof(ranges) / sizeof(ranges[0]);
+
+uint8_t image[96];  // must be at least VFD::paramImageSize(ranges, num_ranges) bytes
+
+
+void setup() {
+  Serial.begin(9600);
+  Serial2.begin(38400, SERIAL_8O1);
+  inverter.begin();
+
+  Serial.print("Image size needed: ");
+  Serial.println(VFD::paramImageSize(ranges, num_ranges));
+
+  // dump parameters to the image
+  uint16_t size = inverter.dumpParameters(ranges, num_ranges, image, sizeof(image));
+  if(size == 0) {
+    Serial.print("Dump failed: ");
+    Serial.println(inverter.lastCommError());
+    return;
+  }
+
+  Serial.print("Dumped parameters of drive with cpu id ");
+  Serial.println(VFD::paramImageCpuID(image), HEX);
+
+  // print the image as hex, so it can be saved and loaded back later
+  for(uint16_t i = 0; i < size; i++) {
+    if(image[i] < 0x10) Serial.print('0');
+    Serial.print(image[i], HEX);
+  }
+  Serial.println();
+
+  // restore the image: reads the ranges back and writes only what changed
+  if(inverter.restoreParameters(image, size) != VFD_COMM_SUCCESS) {
+    Serial.print("Restore failed: ");
+  }
+  else {
+    Serial.print("Restore done: ");
+  }
+  Serial.println(inverter.lastCommError());
+}
+
+void loop() {
+  // nothing to do here
+
+}
@@ -0,0 +1,74 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to serve two drives to Modbus TCP clients (SCADA, HMI, ecc...).
+    This example uses an arduino MEGA board (multiple serial) with an Ethernet shield.
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+    Drives have address 10 and 11 (param P03.01), clients reach them with the same unit id.
+
+    Reads of the registers polled by update() (frequencies, current, voltages, ecc...)
+    are answered from the last update, without waiting for the drive.
+*/
+#include <SPI.h>
+#include <Ethernet.h>
+#include <VFDGateway.h>
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFDBus bus(Serial2, 38400, comm_pin);
+VFD spindle(10, bus);  // drives on the bus share its line
+VFD pump(11, bus);
+VFDGateway gateway(bus);
+
+byte mac[] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+IPAddress ip(192, 168, 1, 177);
+EthernetServer server(502); // Modbus TCP port
+
+const uint8_t max_clients = 2;
+EthernetClient clients[max_clients];
+VFD_GatewayClient client_states[max_clients];
+
+
+void setup() {
+  Serial2.begin(38400, SERIAL_8O1);
+  bus.begin();
+  gateway.addDrive(10, spindle);
+  gateway.addDrive(11, pump);
+  gateway.setPollInterval(100); // each drive updated every 100ms
+
+  Ethernet.begin(mac, ip);
+  server.begin();
+}
+
+void loop() {
+  bus.poll();
+  gateway.poll();
+
+  // accept new clients in a free slot
+  EthernetClient incoming = server.accept();
+  if(incoming) {
+    for(uint8_t i = 0; i < max_clients; i++) {
+      if(!clients[i]) {
+        gateway.reset(client_states[i]);
+        clients[i] = incoming;
+        break;
+      }
+    }
+  }
+
+  for(uint8_t i = 0; i < max_clients; i++) {
+    if(clients[i] && !clients[i].connected()) clients[i].stop();
+    if(clients[i]) gateway.serve(client_states[i], clients[i]);
+  }
+}
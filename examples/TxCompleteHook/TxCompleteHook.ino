@@ -0,0 +1,72 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to switch the MAX485 back to receive from the TX complete interrupt
+    of the serial (VFD_DIRECTION_TX_HOOK): the pin is released right after the last stop bit,
+    without waiting in flush(). This example uses an arduino MEGA board, Serial2 is USART2.
+
+    Connections as follow:
+
+    Arduino PIN       -   MAX485 module
+    +5V               -   VCC
+    GND               -   GND
+    D15               -   DE (connected togheter with RE)
+    D15               -   RE (connected togheter with DE)
+    D16 (Serial2 TX)  -   DI
+    D17 (Serial2 RX)  -   RO
+
+    VFD parameters as in the StartStop example (address 10, 38400 baud, 8O1).
+*/
+#include <YL620-Arduino.h>
+
+#if !defined(USART2_TX_vect)
+  #error "This example needs an AVR board with USART2 (es. MEGA)"
+#endif
+
+const int comm_pin = 15;
+VFD inverter(10, Serial2, 38400, comm_pin);
+
+// HardwareSerial doesn't use the TX complete interrupt, the sketch can have it.
+// The hardware clears the TX complete flag when it runs: that's why the library doesn't call
+// flush() in this mode, it would wait for that flag forever.
+ISR(USART2_TX_vect) {
+  inverter.txComplete();
+}
+
+
+void setup() {
+  Serial.begin(9600);
+  Serial2.begin(38400, SERIAL_8O1);
+
+  inverter.setDirectionMode(VFD_DIRECTION_TX_HOOK); // before begin()
+  inverter.begin();
+  UCSR2B |= _BV(TXCIE2);  // enable the TX complete interrupt, after Serial2.begin()
+
+  Serial.print("Drive cpu id: ");
+  Serial.println(inverter.getCpuID(), HEX);
+  Serial.println(inverter.lastCommError());
+}
+
+void loop() {
+  // poll the drive once a second
+  if(inverter.update() == VFD_COMM_SUCCESS) {
+    Serial.print("Run frequency: ");
+    Serial.print(inverter.fetchRunFrequency(), 1);
+    Serial.println(" Hz");
+  }
+  else {
+    Serial.println(inverter.lastCommError());
+  }
+  delay(1000);
+}
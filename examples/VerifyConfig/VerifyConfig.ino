@@ -0,0 +1,79 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    This example shows how to check the VFD parameters against the expected configuration
+    when commissioning (or swapping) a drive.
+    This example uses an arduino MEGA board (multiple serial).
+
+    Using a MAX485 module for communication, connections as in the StartStop example.
+*/
+#include <YL620-Arduino.h>
+
+const int comm_pin = 15;  // using pin D15 for commutating between receive and transmit mode in MAX485
+VFD inverter(10, Serial2, 38400, comm_pin);
+
+/*
+  Expected configuration, as {section, parameter, value}.
+  These are the parameters listed in the StartStop example.
+  Keep it sorted: near parameters of the same section are read with a single request.
+*/
+constexpr VFD_ParamExpect golden[] = {
+  {0, 1, 3},  // P00.01 => 3 (allows command over RS485)
+  {3, 0, 5},  // P03.00 => 5 (38400 baud serial "speed")
+  {3, 1, 10}, // P03.01 => 10 (modbus address of VFD)
+  {3, 2, 0},  // P03.02 => 0 (SERIAL_8O1)
+  {7, 8, 5},  // P07.08 => 5 (VFD frequency set via RS485)
+};
+constexpr uint8_t golden_num = sizeof(golden) / sizeof(golden[0]);
+
+// checked at compile time: the table is sorted and needs only 3 requests (P00, P03 and P07)
+static_assert(VFD_configSorted(golden, golden_num), "golden configuration must be sorted");
+static_assert(VFD_configReads(golden, golden_num) == 3, "golden configuration takes more requests than expected");
+
+
+void setup() {
+  Serial.begin(9600);
+  Serial2.begin(38400, SERIAL_8O1);
+  inverter.begin();
+
+  VFD_ParamMismatch mismatches[golden_num];
+  uint8_t num_mismatches;
+  if(inverter.verifyConfig(golden, golden_num, mismatches, golden_num, &num_mismatches) != VFD_COMM_SUCCESS) {
+    Serial.print("Verify failed: ");
+    Serial.println(inverter.lastCommError());
+    return;
+  }
+
+  if(num_mismatches == 0) {
+    Serial.println("Configuration OK");
+    return;
+  }
+
+  // print the parameters to fix
+  for(uint8_t i = 0; i < num_mismatches; i++) {
+    Serial.print("P");
+    Serial.print(mismatches[i].section);
+    Serial.print(".");
+    Serial.print(mismatches[i].param);
+    Serial.print(" expected ");
+    Serial.print(mismatches[i].expected);
+    Serial.print(" found ");
+    Serial.println(mismatches[i].actual);
+  }
+}
+
+void loop() {
+  // nothing to do here
+
+}
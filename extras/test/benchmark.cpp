@@ -0,0 +1,224 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Benchmarks of the library on simulated lines, in virtual time
+    @file benchmark.cpp
+    @author Lorenzo Carloni
+
+    Usage: benchmark [drives]  (default 8, max 32)
+    - polling: the drives updated by VFDBus tasks and by blocking update(): updates/s, and the
+      time spent in each loop() (how long the rest of the sketch waits)
+    - float/integer API: host time of the float fetch methods against the 0.1Hz ones. On AVR
+      the float ones also pull in the soft float code, compare the flash of the sketches there.
+    - writes: single register writes/s with VFD_WRITE_ECHO and VFD_WRITE_NO_ACK (counting the
+      verifyWrites() of the no-ack ones), and broadcast
+    Line times are virtual (VFD_VIRTUAL_TIME): the same on any PC, and what a board would see.
+*/
+
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#include <VFDTask.h>
+#include <VFDSim.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#ifndef VFD_VIRTUAL_TIME
+  #error "Build with -DVFD_VIRTUAL_TIME"
+#endif
+
+#define MAX_DRIVES 32
+#define POLL_BAUD 115200
+#define WRITE_BAUD 38400
+#define RUN_TIME 5000 // ms of simulated time of each polling run
+#define NUM_WRITES 200
+#define API_CALLS 10000000UL
+
+VFD_SimDrive sim_drives[MAX_DRIVES];
+uint8_t num_drives = 8;
+
+/// Updates and time spent in loop() during a run
+struct LoopStats {
+  uint32_t updates;
+  uint32_t failures;
+  uint32_t loops;
+  uint64_t loop_sum_us;
+  uint32_t loop_max_us;
+};
+
+// Accounts one loop() call
+static void countLoop(LoopStats& stats, uint32_t start_us) {
+  uint32_t us = VFD_MICROS() - start_us;
+  stats.loops++;
+  stats.loop_sum_us += us;
+  if(us > stats.loop_max_us) stats.loop_max_us = us;
+}
+
+// Prints the results of a run
+static void printLoop(const char* name, const LoopStats& stats) {
+  printf("  %-9s %6lu updates/s  %4lu failed  loop avg %6lu us  max %6lu us\n", name,
+    (unsigned long)(stats.updates * 1000ULL / RUN_TIME), (unsigned long)stats.failures,
+    (unsigned long)(stats.loops > 0 ? stats.loop_sum_us / stats.loops : 0), (unsigned long)stats.loop_max_us);
+}
+
+
+// Polling through VFDBus
+
+VFDBus* bus;
+VFD* bus_drives[MAX_DRIVES];
+VFD_Transaction updates[MAX_DRIVES];
+VFD_Task tasks[MAX_DRIVES];
+LoopStats bus_stats;
+
+// Task updating a drive over and over
+static bool updateTask(uint8_t i) {
+  VFD_TASK_BEGIN(tasks[i]);
+  VFD_TASK_RUN(tasks[i], bus->update(updates[i], *bus_drives[i]), updates[i]);
+  if(updates[i].error == VFD_COMM_SUCCESS) bus_stats.updates++;
+  else bus_stats.failures++;
+  VFD_TASK_END(tasks[i]);
+}
+
+// Updates the drives by tasks, loop() never waits for the line
+static void pollWithBus() {
+  VFDSimLine line(POLL_BAUD, sim_drives, num_drives);
+  VFDBus task_bus(line, POLL_BAUD);
+  bus = &task_bus;
+  for(uint8_t i = 0; i < num_drives; i++) bus_drives[i] = new VFD(i + 1, task_bus);
+  task_bus.begin();
+
+  uint32_t started = VFD_MILLIS();
+  while(VFD_MILLIS() - started < RUN_TIME) {
+    uint32_t start_us = VFD_MICROS();
+    task_bus.poll();
+    for(uint8_t i = 0; i < num_drives; i++) updateTask(i);
+    countLoop(bus_stats, start_us);
+  }
+  printLoop("VFDBus", bus_stats);
+
+  // the line goes away with this function: let the updates on it end
+  for(uint8_t i = 0; i < num_drives; i++) {
+    while(updates[i].state == VFD_TRANSACTION_QUEUED || updates[i].state == VFD_TRANSACTION_SENT) task_bus.poll();
+    delete bus_drives[i];
+  }
+}
+
+
+// Polling with blocking update()
+
+// Updates a drive in each loop(), loop() waits for its answer
+static void pollBlocking() {
+  VFDSimLine line(POLL_BAUD, sim_drives, num_drives);
+  VFD* drives[MAX_DRIVES];
+  for(uint8_t i = 0; i < num_drives; i++) {
+    drives[i] = new VFD(i + 1, line, POLL_BAUD);
+    drives[i]->begin();
+  }
+
+  LoopStats stats = {};
+  uint8_t next = 0;
+  uint32_t started = VFD_MILLIS();
+  while(VFD_MILLIS() - started < RUN_TIME) {
+    uint32_t start_us = VFD_MICROS();
+    if(drives[next]->update() == VFD_COMM_SUCCESS) stats.updates++;
+    else stats.failures++;
+    next = (next + 1) % num_drives;
+    countLoop(stats, start_us);
+  }
+  printLoop("blocking", stats);
+
+  for(uint8_t i = 0; i < num_drives; i++) delete drives[i];
+}
+
+
+// Float and integer API
+
+// Host time of a fetch method, in ns per call
+template<typename T>
+static double fetchTime(VFD& drive, T (VFD::*fetch)()) {
+  volatile T sink;
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t n = 0; n < API_CALLS; n++) sink = (drive.*fetch)();
+  (void)sink;
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / API_CALLS;
+}
+
+// Fetches the same registers in Hz (float) and in 0.1Hz
+static void apiCost() {
+  VFDSimLine line(POLL_BAUD, sim_drives, 1);
+  VFD drive(1, line, POLL_BAUD);
+  drive.begin();
+  drive.update();
+
+  double run_float = fetchTime(drive, &VFD::fetchRunFrequency);
+  double run_int = fetchTime(drive, &VFD::fetchRunFrequencyDeciHz);
+  double aim_float = fetchTime(drive, &VFD::fetchAimFrequency);
+  double aim_int = fetchTime(drive, &VFD::fetchAimFrequencyDeciHz);
+  printf("  fetchRunFrequency %5.2f ns  fetchRunFrequencyDeciHz %5.2f ns\n", run_float, run_int);
+  printf("  fetchAimFrequency %5.2f ns  fetchAimFrequencyDeciHz %5.2f ns\n", aim_float, aim_int);
+}
+
+
+// Write throughput
+
+// Writes the speed NUM_WRITES times in a write mode, returns writes/s
+static uint32_t writeRate(uint8_t address, VFD_Write_Modes mode, uint8_t* failed) {
+  VFDSimLine line(WRITE_BAUD, sim_drives, 1);
+  VFD drive(address, line, WRITE_BAUD);
+  drive.begin();
+  drive.setWriteMode(mode);
+
+  *failed = 0;
+  uint32_t start_us = VFD_MICROS();
+  for(uint16_t n = 0; n < NUM_WRITES; n++) {
+    if(drive.setSpeedDeciHz(100 + n) != VFD_COMM_SUCCESS) (*failed)++;
+  }
+  if(mode == VFD_WRITE_NO_ACK && drive.verifyWrites() != VFD_COMM_SUCCESS) (*failed)++;
+  uint32_t us = VFD_MICROS() - start_us;
+  if(sim_drives[0].regs[VFD_REGISTER_FREQUENCY - VFD_SIM_FIRST_REGISTER] != 100 + NUM_WRITES - 1) (*failed)++;
+  return (uint32_t)(NUM_WRITES * 1000000ULL / us);
+}
+
+// Writes with and without waiting for the echo, and broadcast
+static void writeThroughput() {
+  uint8_t echo_failed, no_ack_failed, broadcast_failed;
+  uint32_t echo = writeRate(1, VFD_WRITE_ECHO, &echo_failed);
+  uint32_t no_ack = writeRate(1, VFD_WRITE_NO_ACK, &no_ack_failed);
+  uint32_t broadcast = writeRate(0, VFD_WRITE_NO_ACK, &broadcast_failed);
+  printf("  echo      %5lu writes/s  %u failed\n", (unsigned long)echo, echo_failed);
+  printf("  no-ack    %5lu writes/s  %u failed\n", (unsigned long)no_ack, no_ack_failed);
+  printf("  broadcast %5lu writes/s  %u failed\n", (unsigned long)broadcast, broadcast_failed);
+}
+
+
+int main(int argc, char** argv) {
+  if(argc > 1) num_drives = atoi(argv[1]);
+  if(num_drives < 1 || num_drives > MAX_DRIVES) {
+    fprintf(stderr, "drives: 1 to %u\n", MAX_DRIVES);
+    return 2;
+  }
+
+  printf("Polling %u drives at %u baud, %u ms:\n", num_drives, POLL_BAUD, RUN_TIME);
+  pollWithBus();
+  pollBlocking();
+  printf("Float and integer API (host):\n");
+  apiCost();
+  printf("Single register writes at %u baud:\n", WRITE_BAUD);
+  writeThroughput();
+  return 0;
+}
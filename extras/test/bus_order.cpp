@@ -0,0 +1,105 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Order of the VFDBus transactions on a simulated line
+    @file bus_order.cpp
+    @author Lorenzo Carloni
+
+    Reads of the same drive are coalesced into one request, but never across a write: a read
+    queued after a write must see the written value, the one queued before it the old one.
+*/
+
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#include <VFDSim.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define BAUD 38400
+#define NUM_DRIVES 2
+#define REG(r) ((r) - VFD_SIM_FIRST_REGISTER) // index in VFD_SimDrive::regs
+
+VFD_SimDrive sim_drives[NUM_DRIVES];
+VFDSimLine line(BAUD, sim_drives, NUM_DRIVES);
+VFDBus bus(line, BAUD);
+VFD drive(1, bus);
+VFD other(2, bus);
+
+// Polls the bus until every transaction is done
+static void run(VFD_Transaction* t[], uint8_t n) {
+  for(uint32_t polls = 0; polls < 1000000; polls++) {
+    bus.poll();
+    uint8_t done = 0;
+    while(done < n && VFDBus::done(*t[done])) done++;
+    if(done == n) return;
+  }
+  assert(!"transactions never completed");
+}
+
+// Read, write of the same register, read
+static void readAfterWrite() {
+  VFD_Transaction before, write, after;
+  sim_drives[0].regs[REG(VFD_REGISTER_ACCEL_TIME)] = 50;
+  assert(bus.read(before, drive, VFD_REGISTER_ACCEL_TIME));
+  assert(bus.write(write, drive, VFD_REGISTER_ACCEL_TIME, 120));
+  assert(bus.read(after, drive, VFD_REGISTER_ACCEL_TIME));
+  VFD_Transaction* t[] = {&before, &write, &after};
+  run(t, 3);
+
+  assert(before.error == VFD_COMM_SUCCESS && before.value == 50);
+  assert(write.error == VFD_COMM_SUCCESS);
+  assert(after.error == VFD_COMM_SUCCESS && after.value == 120);
+}
+
+// Read, write to another drive, read: not joined either
+static void readAfterOtherWrite() {
+  VFD_Transaction before, write, after;
+  uint16_t coalesced = bus.coalescedCount();
+  assert(bus.read(before, drive, VFD_REGISTER_ACCEL_TIME));
+  assert(bus.write(write, other, VFD_REGISTER_ACCEL_TIME, 80));
+  assert(bus.read(after, drive, VFD_REGISTER_DECEL_TIME));
+  VFD_Transaction* t[] = {&before, &write, &after};
+  run(t, 3);
+
+  assert(before.error == VFD_COMM_SUCCESS && write.error == VFD_COMM_SUCCESS && after.error == VFD_COMM_SUCCESS);
+  assert(bus.coalescedCount() == coalesced);
+  assert(sim_drives[1].regs[REG(VFD_REGISTER_ACCEL_TIME)] == 80);
+}
+
+// Reads with no write between them are still joined
+static void readsCoalesced() {
+  VFD_Transaction first, second;
+  uint16_t coalesced = bus.coalescedCount();
+  sim_drives[0].regs[REG(VFD_REGISTER_DECEL_TIME)] = 70;
+  assert(bus.read(first, drive, VFD_REGISTER_ACCEL_TIME));
+  assert(bus.read(second, drive, VFD_REGISTER_DECEL_TIME));
+  VFD_Transaction* t[] = {&first, &second};
+  run(t, 2);
+
+  assert(first.error == VFD_COMM_SUCCESS && first.value == 120);
+  assert(second.error == VFD_COMM_SUCCESS && second.value == 70);
+  assert(bus.coalescedCount() == coalesced + 1);
+}
+
+int main() {
+  bus.begin();
+  readAfterWrite();
+  readAfterOtherWrite();
+  readsCoalesced();
+  puts("bus_order: ok");
+  return 0;
+}
@@ -0,0 +1,367 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Property test of the receive paths, on random byte streams, split points and timing
+    @file fuzz_response.cpp
+    @author Lorenzo Carloni
+
+    Every input is a script: which request the library makes (blocking VFD calls or VFDBus
+    transactions), and for every request the line answers with a clean frame, a frame with a
+    corrupted byte, an exception, random garbage, or nothing; stale bytes may wait in the receive
+    buffer, and the answer arrives split in chunks with gaps (a gap may outlast the timeout).
+    Checked: clean answers always succeed with the right values, corrupted answers never succeed,
+    exceptions are reported, and the bytes read per request are bounded whatever arrives.
+    Out of bounds accesses are left to the sanitizers (see README.md).
+
+    Runs random scripts by itself, or is a libFuzzer target when built with -DVFD_LIBFUZZER.
+*/
+
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define BAUD 38400
+#define ADDRESS 10
+/// Time a char takes on the line, in microseconds
+#define CHAR_US (11000000UL / BAUD)
+/// Time the scripted drive takes to start answering, in microseconds
+#define TURNAROUND_US 500
+/// Max extra time the gaps of a clean answer add, so it stays within the timeout
+#define MAX_GAPS_US 40000UL
+/// Max bytes read for a single request: the drain of stale bytes and the longest answer
+#define MAX_READS_PER_REQUEST (VFD_MAX_DRAIN + 5 + 2*VFD_MAX_RANGE_REGISTERS)
+/// Max calls of VFDBus::poll() for a transaction: the gap, the timeout and the answer, with the clock ticking
+#define MAX_POLLS (1000000UL / STUB_TICK_US)
+
+/// What the line answers to a request
+enum Answer : uint8_t {
+  ANSWER_CLEAN = 0,
+  ANSWER_CORRUPTED,
+  ANSWER_EXCEPTION,
+  ANSWER_GARBAGE,
+  ANSWER_NONE,
+  ANSWER_STALLED, ///< Clean, but a gap longer than the timeout in the middle
+  NUM_ANSWERS
+};
+
+/// Bytes of the input, zeros once over
+struct Script {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+
+  uint8_t next() {
+    return pos < size ? data[pos++] : 0;
+  }
+};
+
+/// Value of a register of the scripted drive
+static uint16_t regValue(uint16_t r) {
+  return (uint16_t)(r*31 + 7);
+}
+
+/// MODBUS CRC, computed here independently of the library
+static uint16_t modbusCrc(const uint8_t* buf, uint8_t len) {
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for(uint8_t b = 0; b < 8; b++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+
+/**
+ * @brief Line with a scripted drive behind it
+ */
+class ScriptedLine : public Stream {
+  uint8_t request[9+2*VFD_MAX_RANGE_REGISTERS];
+  uint8_t request_len;
+
+  uint8_t rx[1024];
+  uint32_t rx_us[1024]; ///< Clock each byte is received at
+  uint16_t rx_head;
+  uint16_t rx_tail;
+
+  void push(uint8_t b, uint32_t at) {
+    if(rx_tail == sizeof(rx)) return;
+    rx[rx_tail] = b;
+    rx_us[rx_tail++] = at;
+  }
+
+  uint8_t requestLength() {
+    if(request_len < 7 || request[1] != 0x10) return 8;
+    return 9 + request[6];
+  }
+
+  // Answer of the scripted drive, with CRC
+  uint8_t buildAnswer(uint8_t* frame, bool exception) {
+    uint8_t n;
+    frame[0] = request[0];
+    if(exception) {
+      frame[1] = request[1] | 0x80;
+      frame[2] = 0x02;
+      n = 3;
+    }
+    else if(request[1] == 0x03) {
+      uint16_t start = (request[2] << 8) | request[3];
+      uint8_t count = request[5];
+      frame[1] = 0x03;
+      frame[2] = 2*count;
+      for(uint8_t i = 0; i < count; i++) {
+        frame[3+2*i] = (uint8_t)(regValue(start+i) >> 8);
+        frame[4+2*i] = (uint8_t)regValue(start+i);
+      }
+      n = 3 + 2*count;
+    }
+    else {  // write single and multiple registers: echo of the first 6 bytes
+      memcpy(frame, request, 6);
+      n = 6;
+    }
+    uint16_t crc = modbusCrc(frame, n);
+    frame[n] = (uint8_t)crc;
+    frame[n+1] = (uint8_t)(crc >> 8);
+    return n + 2;
+  }
+
+  // Queues the answer to a complete request, as the script says
+  void answer() {
+    uint8_t frame[5+2*VFD_MAX_RANGE_REGISTERS];
+    Answer kind = (Answer)(script->next() % NUM_ANSWERS);
+    served[kind] = true;
+    if(kind == ANSWER_NONE) return;
+
+    uint8_t len;
+    if(kind == ANSWER_GARBAGE) {
+      len = script->next() % sizeof(frame);
+      for(uint8_t i = 0; i < len; i++) frame[i] = script->next();
+    }
+    else {
+      len = buildAnswer(frame, kind == ANSWER_EXCEPTION);
+    }
+    if(kind == ANSWER_CORRUPTED) {
+      // never the function: a corrupted one could pass for a shorter exception frame
+      uint8_t pos = script->next() % (len - 1);
+      if(pos >= 1) pos++;
+      frame[pos] ^= script->next() | 1;
+    }
+
+    // the answer arrives in chunks, with gaps between them
+    uint8_t stall_at = kind == ANSWER_STALLED ? script->next() % len : len;
+    uint32_t at = stub_us + TURNAROUND_US;
+    uint32_t gaps = 0;
+    uint8_t chunk_left = 0;
+    for(uint8_t i = 0; i < len; i++) {
+      if(chunk_left == 0) {
+        chunk_left = script->next() % 8 + 1;
+        uint32_t gap = (script->next() % 8) * 250UL;
+        if(gaps + gap > MAX_GAPS_US) gap = 0;
+        gaps += gap;
+        at += gap;
+      }
+      if(i == stall_at) at += (COMM_TIMEOUT_TIME + 50) * 1000UL;
+      at += CHAR_US;
+      push(frame[i], at);
+      chunk_left--;
+    }
+  }
+
+public:
+  Script* script; ///< Script of the current input
+  bool served[NUM_ANSWERS]; ///< Kinds of answer served since clear()
+  uint32_t reads; ///< Bytes read since the last request started
+  uint32_t max_reads; ///< Max bytes read for a single request since clear()
+  uint8_t stale_left; ///< Stale bytes not drained before the last request
+
+  void clear() {
+    request_len = 0;
+    rx_head = rx_tail = 0;
+    memset(served, 0, sizeof(served));
+    reads = max_reads = 0;
+    stale_left = 0;
+  }
+
+  // Stale bytes waiting in the receive buffer
+  void addStale(uint16_t count) {
+    for(uint16_t i = 0; i < count; i++) push(script->next(), stub_us);
+  }
+
+  int available() {
+    uint16_t n = 0;
+    for(uint16_t i = rx_head; i < rx_tail && (int32_t)(stub_us - rx_us[i]) >= 0; i++) n++;
+    return n > 255 ? 255 : n;  // as a serial buffer would
+  }
+
+  int read() {
+    if(available() == 0) return -1;
+    reads++;
+    return rx[rx_head++];
+  }
+
+  int peek() {
+    if(available() == 0) return -1;
+    return rx[rx_head];
+  }
+
+  size_t write(uint8_t b) {
+    if(request_len == 0) {  // a new request: check the cost of the previous one
+      if(reads > max_reads) max_reads = reads;
+      reads = 0;
+      if(available() > 0) stale_left = 1;
+    }
+    request[request_len++] = b;
+    if(request_len >= requestLength()) {
+      request_len = 0;
+      answer();
+    }
+    return 1;
+  }
+};
+
+
+ScriptedLine line;
+VFDBus bus(line, BAUD);
+VFD drive(ADDRESS, bus);
+
+static uint32_t runs[NUM_ANSWERS];
+
+
+// Runs a single script
+static void runScript(const uint8_t* data, size_t size) {
+  Script script = {data, size, 0};
+  line.script = &script;
+  line.clear();
+  stub_us += 1000000UL; // far from whatever the last script left on the line
+
+  uint8_t op = script.next() % 7;
+  uint8_t first = script.next() % 0x20;
+  uint8_t count = script.next() % VFD_MAX_RANGE_REGISTERS + 1;
+  uint16_t value = (script.next() << 8) | script.next();
+  uint8_t stale = script.next();
+  line.addStale(stale > 200 ? VFD_MAX_DRAIN + stale : stale % 32);
+
+  uint16_t values[VFD_MAX_RANGE_REGISTERS];
+  uint16_t expected[VFD_MAX_RANGE_REGISTERS];
+  uint16_t start = (3 << 8) | first;
+  for(uint8_t i = 0; i < count; i++) {
+    expected[i] = regValue(start+i);
+    values[i] = value + i;
+  }
+
+  VFD_Comm_Errors error;
+  bool checked = true;  // values read to compare with expected
+  VFD_Transaction t;
+  uint32_t polls = 0;
+  switch(op) {
+    case 0:
+      values[0] = drive.getParameter(3, first);
+      error = drive.lastCommErrorNum();
+      count = 1;
+      break;
+    case 1:
+      error = drive.getParameters(3, first, count, values);
+      break;
+    case 2:
+      start = VFD_POLL_START;
+      count = 1;
+      error = drive.update();
+      expected[0] = regValue(start);
+      if(!drive.fetchPolled(start, &values[0])) values[0] = expected[0];
+      break;
+    case 3:
+      error = drive.setParameter(3, first, value);
+      checked = false;
+      break;
+    case 4:
+      error = drive.setParameters(3, first, count < 2 ? 2 : count, values);
+      checked = false;
+      break;
+    case 5:
+      bus.read(t, drive, start, count, values);
+      while(!VFDBus::done(t)) {
+        bus.poll();
+        assert(++polls < MAX_POLLS);
+      }
+      error = t.error;
+      break;
+    default:
+      bus.write(t, drive, start, value);
+      while(!VFDBus::done(t)) {
+        bus.poll();
+        assert(++polls < MAX_POLLS);
+      }
+      error = t.error;
+      checked = false;
+      break;
+  }
+  if(line.reads > line.max_reads) line.max_reads = line.reads;
+
+  // bounded cost, whatever came from the line
+  assert(line.max_reads <= MAX_READS_PER_REQUEST);
+
+  bool* served = line.served;
+  bool unknown = served[ANSWER_GARBAGE] || line.stale_left;  // garbage could be a valid frame
+  bool clean_only = !unknown && !served[ANSWER_CORRUPTED] && !served[ANSWER_EXCEPTION]
+      && !served[ANSWER_NONE] && !served[ANSWER_STALLED];
+  bool fallback = op == 4;  // setParameters() falls back to single writes on exceptions
+
+  if(clean_only) assert(error == VFD_COMM_SUCCESS);
+  if(error == VFD_COMM_SUCCESS && checked && !unknown) {
+    for(uint8_t i = 0; i < count; i++) assert(values[i] == expected[i]);
+  }
+  if(!unknown && served[ANSWER_CORRUPTED]) assert(error != VFD_COMM_SUCCESS);
+  if(!unknown && !fallback && served[ANSWER_EXCEPTION]) assert(error == VFD_COMM_ERROR_EXCEPTION);
+  if(!unknown && (served[ANSWER_NONE] || served[ANSWER_STALLED]) && !fallback) assert(error != VFD_COMM_SUCCESS);
+
+  for(uint8_t k = 0; k < NUM_ANSWERS; k++) {
+    if(served[k]) runs[k]++;
+  }
+}
+
+
+#ifdef VFD_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  runScript(data, size);
+  return 0;
+}
+#else
+int main(int argc, char** argv) {
+  uint32_t num_scripts = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+  uint32_t seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+  if(seed == 0) seed = 1;
+
+  static uint8_t data[4096];
+  for(uint32_t n = 0; n < num_scripts; n++) {
+    size_t size = 16 + seed % (sizeof(data) - 16);
+    for(size_t i = 0; i < size; i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = (uint8_t)seed;
+    }
+    runScript(data, size);
+  }
+
+  printf("%lu scripts, answers: clean %lu, corrupted %lu, exception %lu, garbage %lu, none %lu, stalled %lu\n",
+      (unsigned long)num_scripts, (unsigned long)runs[ANSWER_CLEAN], (unsigned long)runs[ANSWER_CORRUPTED],
+      (unsigned long)runs[ANSWER_EXCEPTION], (unsigned long)runs[ANSWER_GARBAGE], (unsigned long)runs[ANSWER_NONE],
+      (unsigned long)runs[ANSWER_STALLED]);
+  return 0;
+}
+#endif
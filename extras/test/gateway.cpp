@@ -0,0 +1,266 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Modbus TCP requests served by VFDGateway, for drives on a simulated line
+    @file gateway.cpp
+    @author Lorenzo Carloni
+
+    Clients are fake connections: the test writes MBAP frames into them and reads back what
+    the gateway answered. Polled registers must come from the mirror without touching the line,
+    anything else must be forwarded, and every error must be an exception answer.
+*/
+
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#include <VFDGateway.h>
+#include <VFDSim.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define BAUD 38400
+#define NUM_DRIVES 2
+#define UNIT_ID 10
+#define OTHER_UNIT_ID 11
+#define REG(r) ((r) - VFD_SIM_FIRST_REGISTER) // index in VFD_SimDrive::regs
+
+/// Connection of a fake client: bytes it sent, bytes the gateway answered
+class FakeClient : public Stream {
+  uint8_t input[64];
+  uint8_t in_length = 0;
+  uint8_t in_pos = 0;
+
+public:
+  uint8_t output[128];
+  uint8_t out_length = 0;
+
+  // Client sends a request
+  void send(const uint8_t* data, uint8_t n) {
+    memcpy(input + in_length, data, n);
+    in_length += n;
+  }
+
+  // Client sends a 12 bytes request
+  void send(uint16_t tid, uint8_t unit_id, uint8_t function, uint16_t address, uint16_t value) {
+    uint8_t frame[VFD_MBAP_REQUEST] = {(uint8_t)(tid >> 8), (uint8_t)tid, 0, 0, 0, 6, unit_id, function,
+      (uint8_t)(address >> 8), (uint8_t)address, (uint8_t)(value >> 8), (uint8_t)value};
+    send(frame, VFD_MBAP_REQUEST);
+  }
+
+  // Forgets what was answered
+  void clear() {
+    out_length = 0;
+  }
+
+  size_t write(uint8_t b) {
+    if(out_length >= sizeof(output)) return 0;
+    output[out_length++] = b;
+    return 1;
+  }
+
+  int available() {
+    if(in_pos == in_length) in_pos = in_length = 0;
+    return in_length - in_pos;
+  }
+
+  int read() {
+    return in_pos < in_length ? input[in_pos++] : -1;
+  }
+
+  int peek() {
+    return in_pos < in_length ? input[in_pos] : -1;
+  }
+};
+
+VFD_SimDrive sim_drives[NUM_DRIVES];
+VFDSimLine line(BAUD, sim_drives, NUM_DRIVES);
+VFDBus bus(line, BAUD);
+VFD drive(UNIT_ID, bus);
+VFD other(OTHER_UNIT_ID, bus);
+VFDGateway gateway(bus);
+FakeClient connection, second_connection;
+VFD_GatewayClient client, second_client;
+
+// Polls the bus and serves both clients until they have been answered
+static void serveAll() {
+  for(uint32_t polls = 0; polls < 1000000; polls++) {
+    bus.poll();
+    gateway.serve(client, connection);
+    gateway.serve(second_client, second_connection);
+    if(!client.busy && !second_client.busy) return;
+  }
+  assert(!"requests never answered");
+}
+
+// Polls the bus until a transaction is done
+static void run(VFD_Transaction& t) {
+  for(uint32_t polls = 0; polls < 1000000 && !VFDBus::done(t); polls++) bus.poll();
+  assert(VFDBus::done(t));
+}
+
+// Checks a read answer of one register
+static void checkRead(const FakeClient& c, uint16_t tid, uint8_t function, uint16_t value) {
+  const uint8_t expected[] = {(uint8_t)(tid >> 8), (uint8_t)tid, 0, 0, 0, 5, UNIT_ID, function, 2,
+    (uint8_t)(value >> 8), (uint8_t)value};
+  assert(c.out_length == sizeof(expected));
+  assert(memcmp(c.output, expected, sizeof(expected)) == 0);
+}
+
+// Checks an exception answer
+static void checkException(const FakeClient& c, uint16_t tid, uint8_t unit_id, uint8_t function, uint8_t code) {
+  const uint8_t expected[] = {(uint8_t)(tid >> 8), (uint8_t)tid, 0, 0, 0, 3, unit_id, (uint8_t)(function | 0x80), code};
+  assert(c.out_length == sizeof(expected));
+  assert(memcmp(c.output, expected, sizeof(expected)) == 0);
+}
+
+// First update of both drives, so their mirrors can be served
+static void firstUpdate() {
+  gateway.poll();
+  VFD_Transaction marker;
+  assert(bus.read(marker, drive, VFD_REGISTER_FREQUENCY)); // queued after the updates
+  run(marker);
+}
+
+// A polled register comes from the mirror, the line isn't touched
+static void polledFromMirror() {
+  uint32_t requests = line.requestCount();
+  connection.clear();
+  connection.send(1, UNIT_ID, 0x03, VFD_REGISTER_BUS_VOLT, 1);
+  gateway.serve(client, connection);
+  assert(!client.busy);
+  checkRead(connection, 1, 0x03, sim_drives[0].regs[REG(VFD_REGISTER_BUS_VOLT)]);
+  assert(line.requestCount() == requests);
+}
+
+// Other registers are read from the drive, the same read of two clients is one request
+static void forwardedCoalesced() {
+  sim_drives[0].regs[REG(VFD_REGISTER_FREQUENCY)] = 425;
+  uint32_t requests = line.requestCount();
+  uint16_t coalesced = bus.coalescedCount();
+  connection.clear();
+  second_connection.clear();
+  connection.send(2, UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, 1);
+  second_connection.send(3, UNIT_ID, 0x04, VFD_REGISTER_FREQUENCY, 1);
+  gateway.serve(client, connection);
+  gateway.serve(second_client, second_connection);
+  assert(client.busy && second_client.busy);
+  serveAll();
+
+  checkRead(connection, 2, 0x03, 425);
+  checkRead(second_connection, 3, 0x04, 425);
+  assert(line.requestCount() == requests + 1);
+  assert(bus.coalescedCount() == coalesced + 1);
+}
+
+// A write is echoed, and sent before the reads already queued
+static void writeFirst() {
+  VFD_Transaction queued;
+  sim_drives[0].regs[REG(VFD_REGISTER_ACCEL_TIME)] = 50;
+  assert(bus.read(queued, drive, VFD_REGISTER_ACCEL_TIME));
+  connection.clear();
+  connection.send(4, UNIT_ID, 0x06, VFD_REGISTER_ACCEL_TIME, 120);
+  gateway.serve(client, connection);
+  assert(client.busy);
+  serveAll();
+  run(queued);
+
+  const uint8_t echo[] = {0, 4, 0, 0, 0, 6, UNIT_ID, 0x06,
+    (uint8_t)(VFD_REGISTER_ACCEL_TIME >> 8), (uint8_t)VFD_REGISTER_ACCEL_TIME, 0, 120};
+  assert(connection.out_length == sizeof(echo));
+  assert(memcmp(connection.output, echo, sizeof(echo)) == 0);
+  assert(sim_drives[0].regs[REG(VFD_REGISTER_ACCEL_TIME)] == 120);
+  assert(queued.error == VFD_COMM_SUCCESS && queued.value == 120); // the write went first
+}
+
+// Every error is answered with its exception
+static void exceptions() {
+  // unsupported function (write multiple registers), its body is skipped
+  const uint8_t write_multiple[] = {0, 5, 0, 0, 0, 9, UNIT_ID, 0x10, 0x20, 0x02, 0, 1, 2, 0, 50};
+  connection.clear();
+  connection.send(write_multiple, sizeof(write_multiple));
+  gateway.serve(client, connection);
+  checkException(connection, 5, UNIT_ID, 0x10, VFD_GATEWAY_ILLEGAL_FUNCTION);
+
+  // register count out of range
+  connection.clear();
+  connection.send(6, UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, VFD_MAX_RANGE_REGISTERS + 1);
+  gateway.serve(client, connection);
+  checkException(connection, 6, UNIT_ID, 0x03, VFD_GATEWAY_ILLEGAL_VALUE);
+  connection.clear();
+  connection.send(7, UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, 0);
+  gateway.serve(client, connection);
+  checkException(connection, 7, UNIT_ID, 0x03, VFD_GATEWAY_ILLEGAL_VALUE);
+
+  // the bus doesn't queue a transaction still in use
+  VFD_Transaction& in_use = client.t;
+  assert(bus.read(in_use, drive, VFD_REGISTER_FREQUENCY));
+  connection.clear();
+  connection.send(8, UNIT_ID, 0x06, VFD_REGISTER_FREQUENCY, 300);
+  gateway.serve(client, connection);
+  checkException(connection, 8, UNIT_ID, 0x06, VFD_GATEWAY_DEVICE_BUSY);
+  run(in_use);
+
+  // no drive with that unit id
+  connection.clear();
+  connection.send(9, UNIT_ID + 5, 0x03, VFD_REGISTER_FREQUENCY, 1);
+  gateway.serve(client, connection);
+  checkException(connection, 9, UNIT_ID + 5, 0x03, VFD_GATEWAY_PATH_UNAVAILABLE);
+
+  // drive not answering
+  sim_drives[1].online = false;
+  connection.clear();
+  connection.send(10, OTHER_UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, 1);
+  gateway.serve(client, connection);
+  serveAll();
+  checkException(connection, 10, OTHER_UNIT_ID, 0x03, VFD_GATEWAY_TARGET_FAILED);
+  sim_drives[1].online = true;
+}
+
+// The answer of a request pending when the client is reset is dropped
+static void resetWhileBusy() {
+  connection.clear();
+  connection.send(11, UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, 1);
+  gateway.serve(client, connection);
+  assert(client.busy);
+  gateway.reset(client); // client gone, slot reused
+  serveAll();
+  assert(connection.out_length == 0);
+
+  // the next client of the slot is served as usual
+  connection.send(12, UNIT_ID, 0x03, VFD_REGISTER_FREQUENCY, 1);
+  gateway.serve(client, connection);
+  serveAll();
+  checkRead(connection, 12, 0x03, 425);
+}
+
+int main() {
+  sim_drives[0].address = UNIT_ID;
+  sim_drives[1].address = OTHER_UNIT_ID;
+  bus.begin();
+  gateway.setPollInterval(60000); // only the first update, the tests count the requests
+  gateway.addDrive(UNIT_ID, drive);
+  gateway.addDrive(OTHER_UNIT_ID, other);
+
+  firstUpdate();
+  polledFromMirror();
+  forwardedCoalesced();
+  writeFirst();
+  exceptions();
+  resetWhileBusy();
+  puts("gateway: ok");
+  return 0;
+}
@@ -0,0 +1,58 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Runs the LineSimulation example on a PC
+    @file line_simulation.cpp
+    @author Lorenzo Carloni
+
+    The sketch is built as it is, with Serial printing to stdout: setup(), then loop() until
+    the report is printed. Built with VFD_VIRTUAL_TIME and VFD_SCHED_MAX_DRIVES=32 (as the
+    sketch asks) it takes well under a second, and fails if no drive was updated or the
+    offline drive never came back.
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+
+/// Serial of the sketch, printing to stdout
+class SerialStdout {
+public:
+  void begin(unsigned long) {}
+  void print(const char* s) { printf("%s", s); }
+  void print(long n) { printf("%ld", n); }
+  void print(unsigned long n) { printf("%lu", n); }
+  void print(int n) { printf("%d", n); }
+  void print(unsigned int n) { printf("%u", n); }
+  void print(double n, int digits = 2) { printf("%.*f", digits, n); }
+  template<typename T> void println(T x) { print(x); printf("\n"); }
+};
+
+SerialStdout Serial;
+
+void report();
+
+#include "../../examples/LineSimulation/LineSimulation.ino"
+
+int main() {
+  setup();
+  while(!reported) loop();
+
+  if(num_polled != NUM_DRIVES || updates == 0 || recovery == 0) {
+    fprintf(stderr, "line simulation failed\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Replays a capture dump (VFDCapture::dump()) through VFD::update() on a PC
+    @file replay.cpp
+    @author Lorenzo Carloni
+
+    Every captured request is answered with its captured response through VFDReplay, so the
+    update() results and the decoded values are the ones the board saw, and a failure can be
+    stepped through in a debugger. Requests update() doesn't make (es. writes) are reported as
+    mismatches.
+
+    Usage: replay dump.bin
+    Without a file it captures updates of a simulated drive (one of them lost) and replays
+    them, as a check of the capture and replay path; then replays them once more after a request
+    longer than the captured one, which must not throw the rest out of step.
+*/
+
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDCapture.h>
+#include <VFDSim.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BAUD 38400
+#define MAX_DUMP 65536
+#define SELF_UPDATES 10
+
+/// Print writing into memory, to keep a dump
+class MemoryDump : public Print {
+public:
+  uint8_t data[MAX_DUMP];
+  uint32_t length = 0;
+
+  size_t write(uint8_t b) {
+    if(length >= MAX_DUMP) return 0;
+    data[length++] = b;
+    return 1;
+  }
+};
+
+MemoryDump dump;
+
+// Loads a dump from a file
+static bool load(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if(f == NULL) return false;
+  dump.length = fread(dump.data, 1, MAX_DUMP, f);
+  fclose(f);
+  return true;
+}
+
+// Captures updates of a simulated drive, the answer of one of them is lost
+static void capture() {
+  static VFD_SimDrive sim_drives[1];
+  static VFDSimLine line(BAUD, sim_drives, 1);
+  static uint8_t buffer[2048];
+  VFDCapture capture(buffer, sizeof(buffer));
+  VFD drive(1, line, BAUD);
+  drive.setCapture(&capture);
+
+  drive.setSpeedDeciHz(500);
+  drive.runForward();
+  capture.clear(); // only updates in the dump
+  for(uint8_t i = 0; i < SELF_UPDATES; i++) {
+    sim_drives[0].online = i != SELF_UPDATES / 2;
+    drive.update();
+    VFD_DELAY(100);
+  }
+  capture.dump(dump);
+}
+
+// Address of the drive of the first captured request
+static uint8_t firstAddress() {
+  uint32_t pos = VFD_CAPTURE_HEADER;
+  while(pos + VFD_CAPTURE_RECORD_HEADER < dump.length) {
+    if(dump.data[pos+1] == VFD_CAPTURE_REQUEST && dump.data[pos] > 0) return dump.data[pos + VFD_CAPTURE_RECORD_HEADER];
+    pos += VFD_CAPTURE_RECORD_HEADER + dump.data[pos];
+  }
+  return 0;
+}
+
+// A request of a different length than the captured one is a single mismatch
+static bool resyncs() {
+  VFDReplay replay(dump.data, dump.length);
+  VFD drive(firstAddress(), replay, BAUD);
+  uint16_t values[3] = {1, 2, 3};
+  drive.setParameters(0, 1, 3, values); // in place of the first update, longer
+  uint16_t updates = 1, failed = 1;
+  while(!replay.finished()) {
+    if(drive.update() != VFD_COMM_SUCCESS) failed++;
+    updates++;
+  }
+  return updates == SELF_UPDATES && failed == 2 && replay.mismatchCount() == 1;
+}
+
+int main(int argc, char** argv) {
+  bool self_check = argc < 2;
+  if(self_check) capture();
+  else if(!load(argv[1])) {
+    fprintf(stderr, "can't read %s\n", argv[1]);
+    return 2;
+  }
+
+  VFDReplay replay(dump.data, dump.length);
+  if(!replay.valid()) {
+    fprintf(stderr, "not a capture dump (or unknown version)\n");
+    return 2;
+  }
+
+  VFD drive(firstAddress(), replay, BAUD);
+  uint16_t updates = 0, failed = 0;
+  while(!replay.finished()) {
+    VFD_Comm_Errors result = drive.update();
+    updates++;
+    if(result != VFD_COMM_SUCCESS) failed++;
+    printf("%10lu us  %-26s", (unsigned long)replay.lastTimestamp(), drive.lastCommError());
+    if(result == VFD_COMM_SUCCESS) {
+      printf("  run %5.1f Hz  aim %5.1f Hz  out %3u A  bus %3u V  error %u",
+        drive.fetchRunFrequency(), drive.fetchAimFrequency(), drive.fetchOutCurrent(), drive.fetchBusVoltage(), drive.fetchError());
+    }
+    printf("\n");
+  }
+  printf("%u updates, %u failed, %u requests differ from the capture\n", updates, failed, replay.mismatchCount());
+
+  if(self_check && (updates != SELF_UPDATES || failed != 1 || replay.mismatchCount() != 0 || !resyncs())) {
+    fprintf(stderr, "replay doesn't match the capture\n");
+    return 1;
+  }
+  return 0;
+}
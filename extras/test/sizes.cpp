@@ -0,0 +1,58 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    RAM per drive and per line, checked against the AVR budget on a PC
+    @file sizes.cpp
+    @author Lorenzo Carloni
+
+    The budgets (VFD_SIZE_AVR, VFD_LINE_SIZE_AVR) are for AVR: 2 bytes pointers and no padding.
+    Here the structures are packed too, so the only difference is the width of the pointers
+    (and the port register of VFDDirection, which the stub core doesn't have): the check fails
+    as soon as a member is added without updating the budget, as the build for AVR would.
+    Only the headers are needed, nothing is linked.
+*/
+
+#pragma pack(push, 1)
+#include <Arduino.h>
+#include <YL620-Arduino.h>
+#include <VFDBus.h>
+#pragma pack(pop)
+#include <stdio.h>
+
+/// Bytes a pointer takes more than on AVR
+#define POINTER_EXTRA (sizeof(void*) - 2)
+
+#ifdef portOutputRegister
+  #define DIRECTION_PORT_AVR 0
+#else
+  #define DIRECTION_PORT_AVR 3  // port register pointer and bit mask of VFDDirection
+#endif
+
+/// Budget of a VFD on this machine: the line and capture pointers are wider
+constexpr size_t VFD_BUDGET = VFD_SIZE_AVR + 2*POINTER_EXTRA;
+/// Budget of a VFD_Line on this machine: the stream and next pointers are wider, no port register
+constexpr size_t LINE_BUDGET = VFD_LINE_SIZE_AVR + 2*POINTER_EXTRA - DIRECTION_PORT_AVR;
+
+static_assert(sizeof(VFD) <= VFD_BUDGET, "VFD object grew, update VFD_SIZE_AVR and the VFD documentation");
+static_assert(sizeof(VFD_Line) <= LINE_BUDGET, "VFD_Line grew, update VFD_LINE_SIZE_AVR");
+
+int main() {
+  printf("VFD: %u bytes here, %u on AVR (budget %u)\n", (unsigned)sizeof(VFD),
+    (unsigned)(sizeof(VFD) - 2*POINTER_EXTRA), (unsigned)VFD_SIZE_AVR);
+  printf("VFD_Line: %u bytes here, %u on AVR (budget %u)\n", (unsigned)sizeof(VFD_Line),
+    (unsigned)(sizeof(VFD_Line) - 2*POINTER_EXTRA + DIRECTION_PORT_AVR), (unsigned)VFD_LINE_SIZE_AVR);
+  return 0;
+}
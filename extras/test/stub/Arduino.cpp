@@ -0,0 +1,52 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Host stand-in of the Arduino core
+    @file Arduino.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "Arduino.h"
+
+uint32_t stub_us = 0;
+uint8_t stub_pins[STUB_NUM_PINS];
+
+// Fake clock, in microseconds
+unsigned long micros() {
+  stub_us += STUB_TICK_US;
+  return stub_us;
+}
+
+// Fake clock, in milliseconds
+unsigned long millis() {
+  stub_us += STUB_TICK_US;
+  return stub_us / 1000;
+}
+
+// Moves the fake clock on
+void delay(unsigned long ms) {
+  stub_us += ms * 1000;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+// Records the pin level
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if(pin < STUB_NUM_PINS) stub_pins[pin] = level;
+}
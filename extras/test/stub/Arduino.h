@@ -0,0 +1,85 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Host stand-in of the Arduino core, just what the library uses, for the tests in extras/test
+    @file Arduino.h
+    @author Lorenzo Carloni
+
+    The clock is fake: every reading of it moves it on by STUB_TICK_US, so the busy waits of the
+    library end, and delay() just moves it on. Tests set stub_us to place events in time.
+*/
+
+#ifndef _ARDUINO_STUB_H_
+#define _ARDUINO_STUB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#ifndef STUB_TICK_US
+  /// Time elapsed at every reading of the clock, in microseconds
+  #define STUB_TICK_US 4
+#endif
+
+/// Number of pins whose level is recorded by digitalWrite()
+#define STUB_NUM_PINS 64
+
+/// Fake clock, in microseconds
+extern uint32_t stub_us;
+
+/// Pin levels set by digitalWrite()
+extern uint8_t stub_pins[STUB_NUM_PINS];
+
+typedef bool boolean;
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+
+
+/// Byte output, as the one of the Arduino core
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while(size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* str) {
+    return write((const uint8_t*)str, strlen(str));
+  }
+  virtual void flush() {}
+};
+
+/// Byte input and output, as the one of the Arduino core
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+#endif  // _ARDUINO_STUB_H_
@@ -0,0 +1,341 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Non-blocking transactions for the drives of a RS485 line
+    @file VFDBus.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDBus.h"
+#include "VFDCapture.h"
+
+
+// Private methods
+
+// Adds a transaction to the queue
+bool VFDBus::enqueue(VFD_Transaction& t) {
+  t.state = VFD_TRANSACTION_QUEUED;
+  t.error = VFD_COMM_SUCCESS;
+  t.next = NULL;
+  if(tail != NULL) tail->next = &t;
+  else head = &t;
+  tail = &t;
+  return true;
+}
+
+// Estimated line time of a read request, in microseconds
+uint32_t VFDBus::readCost(uint8_t count) {
+  // request (8) + response (5+2*count) + the 3.5 chars of silence before each, and the drive turnaround
+  return (uint32_t)(8 + 5+2*count + 7)*line.char_us + VFD_TURNAROUND_US;
+}
+
+// Joins the queued reads of the first transaction drive into its request, when cheaper
+void VFDBus::coalesceHead() {
+  active_start = head->start;
+  active_count = head->count;
+  if(head->type != VFD_TRANSACTION_READ) return;
+
+  for(VFD_Transaction* t = head->next; t != NULL; t = t->next) {
+    // a read queued after a write must see the written value: never move it ahead
+    if(t->type == VFD_TRANSACTION_WRITE) break;
+    if(t->type != VFD_TRANSACTION_READ || t->drive != head->drive || t->state != VFD_TRANSACTION_QUEUED) continue;
+
+    uint16_t first = t->start < active_start ? t->start : active_start;
+    uint16_t last = t->start+t->count > active_start+active_count ? t->start+t->count : active_start+active_count;
+    if(last - first > VFD_MAX_RANGE_REGISTERS) continue; // wouldn't fit a single request
+
+    // worth it only if the wider read costs less than a request of its own
+    if(readCost(last - first) >= readCost(active_count) + readCost(t->count)) continue;
+    active_start = first;
+    active_count = last - first;
+    t->state = VFD_TRANSACTION_SENT;
+    coalesced++;
+  }
+}
+
+// Builds and sends the request of the first queued transaction
+void VFDBus::sendHead() {
+  VFD_Transaction* t = head;
+  uint8_t len = 8;
+  coalesceHead();
+  frame[0] = t->drive->address;
+  frame[2] = (uint8_t)(active_start >> 8);
+  frame[3] = (uint8_t)active_start;
+  if(t->type == VFD_TRANSACTION_WRITE) {
+    // write register (6), the response is an echo of the request
+    frame[1] = 0x06;
+    frame[4] = (uint8_t)(t->value >> 8);
+    frame[5] = (uint8_t)t->value;
+    expected = 8;
+  }
+  else {
+    // read registers (3), the response is 3 bytes header + 2 bytes per register + CRC
+    frame[1] = 0x03;
+    frame[4] = 0x00;
+    frame[5] = active_count;
+    expected = 5+2*active_count;
+  }
+
+  // clear receive buffer! bounded, so a babbling line can't keep us here
+  for(uint16_t i = 0; i < VFD_MAX_DRAIN && line.comm_stream->available(); i++) line.comm_stream->read();
+
+  uint16_t crc = VFD::calcCrc(frame, len-2);
+  frame[len-2] = (uint8_t)(crc >> 8);
+  frame[len-1] = (uint8_t)crc;
+
+  line.transceiver.transmit(); // if using a half duplex TTL converter put in transmit mode
+  line.comm_stream->write(frame, len);
+  bool flushed = line.transceiver.needsFlush();
+  if(flushed) { // the pin can be released only when the last byte is out
+    line.comm_stream->flush();
+    line.transceiver.release();
+  }
+  if(t->drive->capture != NULL) t->drive->capture->record(VFD_CAPTURE_REQUEST, frame, len);
+
+  // without flush the frame is still going out of the serial buffer: count its time
+  last_activity = VFD_MICROS();
+  tx_us = flushed ? 0 : (uint32_t)len*line.char_us;
+  received = 0;
+  t->state = VFD_TRANSACTION_SENT;
+  for(VFD_Transaction* q = head; q != NULL; q = q->next) { // coalesced reads went out with it
+    if(q->state == VFD_TRANSACTION_SENT) q->sent_us = last_activity + tx_us;
+  }
+}
+
+// Stores the result of a transaction answered by the frame received
+void VFDBus::complete(VFD_Transaction* t, VFD_Comm_Errors error) {
+  t->done_us = received > 0 ? last_activity : VFD_MICROS(); // last byte, or when we gave up
+  if(error == VFD_COMM_SUCCESS) {
+    uint8_t offset = 3 + 2*(t->start - active_start); // where its registers are in a coalesced read
+    if(t->type == VFD_TRANSACTION_UPDATE) {
+      uint16_t span[VFD_POLL_SPAN];
+      for(uint8_t i = 0; i < VFD_POLL_SPAN; i++) span[i] = (frame[2*i+3] << 8) | frame[2*i+4];
+      t->drive->storePoll(span, t->sent_us, t->done_us);
+    }
+    else if(t->type == VFD_TRANSACTION_READ && t->values == NULL) {
+      t->value = (frame[offset] << 8) | frame[offset+1];
+    }
+    else if(t->type == VFD_TRANSACTION_READ) {
+      for(uint8_t i = 0; i < t->count; i++) t->values[i] = (frame[offset+2*i] << 8) | frame[offset+2*i+1];
+    }
+  }
+  t->next = NULL;
+  t->error = error;
+  t->state = VFD_TRANSACTION_DONE;
+}
+
+// Checks the response, stores the result and removes the transactions on the line from the queue
+void VFDBus::completeHead() {
+  VFD_Transaction* t = head;
+  VFD* drive = t->drive;
+  if(drive->capture != NULL && received > 0) drive->capture->record(VFD_CAPTURE_RESPONSE, frame, received);
+
+  uint8_t function = t->type == VFD_TRANSACTION_WRITE ? 0x06 : 0x03;
+  VFD_Comm_Errors error = drive->checkResponse(frame, received, expected, function);
+  if(error == VFD_COMM_SUCCESS) {
+    if(t->type == VFD_TRANSACTION_WRITE) {
+      // the echo must match the request
+      if(frame[2] != (uint8_t)(t->start >> 8) || frame[3] != (uint8_t)t->start
+          || frame[4] != (uint8_t)(t->value >> 8) || frame[5] != (uint8_t)t->value) {
+        error = drive->last_error = VFD_COMM_ERROR_GENERIC;
+      }
+    }
+    else if(frame[2] != 2*active_count) { // byte count must match what we asked
+      error = drive->last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
+    }
+  }
+
+  head = t->next;
+  complete(t, error);
+
+  // fan the response out to the reads coalesced into it, they share its result
+  VFD_Transaction* prev = NULL;
+  for(VFD_Transaction* q = head; q != NULL; ) {
+    VFD_Transaction* next = q->next;
+    if(q->state == VFD_TRANSACTION_SENT) {
+      if(prev != NULL) prev->next = next;
+      else head = next;
+      complete(q, error);
+    }
+    else {
+      prev = q;
+    }
+    q = next;
+  }
+  tail = prev;
+}
+
+
+// Public methods
+
+// class constructor
+VFD_Transaction::VFD_Transaction() {
+  drive = NULL;
+  type = VFD_TRANSACTION_READ;
+  start = 0;
+  count = 0;
+  values = NULL;
+  value = 0;
+  state = VFD_TRANSACTION_IDLE;
+  error = VFD_COMM_SUCCESS;
+  sent_us = done_us = 0;
+  next = NULL;
+}
+
+// class constructor(s)
+VFDBus::VFDBus(Stream& _comm_stream, uint32_t _baud_rate) : line(_comm_stream, _baud_rate) {
+  head = tail = NULL;
+  received = expected = 0;
+  active_start = active_count = 0;
+  coalesced = 0;
+  last_activity = 0;
+  tx_us = 0;
+}
+VFDBus::VFDBus(Stream& _comm_stream, uint32_t _baud_rate, uint8_t _comm_pin) : line(_comm_stream, _baud_rate, _comm_pin) {
+  head = tail = NULL;
+  received = expected = 0;
+  active_start = active_count = 0;
+  coalesced = 0;
+  last_activity = 0;
+  tx_us = 0;
+}
+
+// Class init routine
+void VFDBus::begin() {
+  line.transceiver.begin();
+  last_activity = VFD_MICROS();
+}
+
+// Sets how the half-duplex transceiver is switched
+void VFDBus::setDirectionMode(VFD_Direction_Modes mode) {
+  line.transceiver.setMode(mode);
+}
+
+// Switches the transceiver back to receive
+void VFDBus::txComplete() {
+  line.transceiver.txComplete();
+}
+
+// Queues a read of consecutive registers
+bool VFDBus::read(VFD_Transaction& t, VFD& drive, uint16_t start, uint8_t count, uint16_t values[]) {
+  if(t.state == VFD_TRANSACTION_QUEUED || t.state == VFD_TRANSACTION_SENT) return false;
+  if(count == 0 || count > VFD_MAX_RANGE_REGISTERS) return false; // wouldn't fit our frame
+  t.drive = &drive;
+  t.type = VFD_TRANSACTION_READ;
+  t.start = start;
+  t.count = count;
+  t.values = values;
+  return enqueue(t);
+}
+
+// Queues a read of a single register
+bool VFDBus::read(VFD_Transaction& t, VFD& drive, uint16_t r) {
+  return read(t, drive, r, 1, NULL);
+}
+
+// Queues a write of a single register
+bool VFDBus::write(VFD_Transaction& t, VFD& drive, uint16_t r, uint16_t value) {
+  if(t.state == VFD_TRANSACTION_QUEUED || t.state == VFD_TRANSACTION_SENT) return false;
+  t.drive = &drive;
+  t.type = VFD_TRANSACTION_WRITE;
+  t.start = r;
+  t.count = 1;
+  t.values = NULL;
+  t.value = value;
+  return enqueue(t);
+}
+
+// Queues a write of a single register before every transaction not sent yet
+bool VFDBus::writeFirst(VFD_Transaction& t, VFD& drive, uint16_t r, uint16_t value) {
+  if(!write(t, drive, r, value)) return false;
+  if(head == &t || (head->next == &t && head->state == VFD_TRANSACTION_SENT)) return true; // already first in line
+
+  // unlink from the tail, where write() put it
+  VFD_Transaction* prev = head;
+  while(prev->next != &t) prev = prev->next;
+  prev->next = NULL;
+  tail = prev;
+
+  // the transaction on the line can't be overtaken
+  VFD_Transaction* after = head->state == VFD_TRANSACTION_SENT ? head : NULL;
+  if(after != NULL) {
+    t.next = after->next;
+    after->next = &t;
+  }
+  else {
+    t.next = head;
+    head = &t;
+  }
+  return true;
+}
+
+// Queues a read of the polled registers of a drive
+bool VFDBus::update(VFD_Transaction& t, VFD& drive) {
+  if(t.state == VFD_TRANSACTION_QUEUED || t.state == VFD_TRANSACTION_SENT) return false;
+  t.drive = &drive;
+  t.type = VFD_TRANSACTION_UPDATE;
+  t.start = VFD_POLL_START;
+  t.count = VFD_POLL_SPAN;
+  t.values = NULL;
+  return enqueue(t);
+}
+
+// Runs the queue
+void VFDBus::poll() {
+  if(head == NULL) return;
+
+  if(head->state == VFD_TRANSACTION_QUEUED) {
+    // MODBUS RTU requires 3.5 chars of silence between frames (unsigned elapsed time, right across the micros() wrap)
+    if((uint32_t)(VFD_MICROS() - last_activity) < tx_us + 35UL*line.char_us/10) return;
+    if(line.busy()) return;  // a drive of the bus left an unacknowledged write
+    sendHead();
+    return;
+  }
+
+  // collect what arrived, stopping early on a MODBUS exception response (5 bytes)
+  while(received < expected && line.comm_stream->available()) {
+    frame[received++] = line.comm_stream->read();
+    last_activity = VFD_MICROS();
+    tx_us = 0;
+    if(received == 5 && (frame[1] & 0x80) && expected > 5) break;
+  }
+
+  bool exception = received == 5 && (frame[1] & 0x80);
+  if(received < expected && !exception && (uint32_t)(VFD_MICROS() - last_activity) < tx_us + COMM_TIMEOUT_TIME*1000UL) return;
+  completeHead();
+}
+
+// Checks if a transaction is finished
+bool VFDBus::done(const VFD_Transaction& t) {
+  return t.state == VFD_TRANSACTION_DONE;
+}
+
+// Checks if there are transactions to run
+bool VFDBus::idle() {
+  return head == NULL;
+}
+
+// Number of reads joined to another request
+uint16_t VFDBus::coalescedCount() {
+  return coalesced;
+}
+
+// Number of queued transactions
+uint8_t VFDBus::pending() {
+  uint8_t n = 0;
+  for(VFD_Transaction* t = head; t != NULL; t = t->next) n++;
+  return n;
+}
@@ -0,0 +1,276 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Non-blocking transactions for the drives of a RS485 line
+    @file VFDBus.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_BUS_H_
+#define _VFD_BUS_H_
+
+#include "YL620-Arduino.h"
+
+#ifndef VFD_TURNAROUND_US
+  /// Usual time the drive takes to start answering, used to weigh the cost of a request
+  #define VFD_TURNAROUND_US 2000
+#endif
+
+/// State of a transaction
+enum VFD_Transaction_States : uint8_t {
+  VFD_TRANSACTION_IDLE = 0, ///< Never queued
+  VFD_TRANSACTION_QUEUED, ///< Waiting its turn on the bus
+  VFD_TRANSACTION_SENT, ///< Request sent (alone or coalesced with another read), waiting the response
+  VFD_TRANSACTION_DONE, ///< Finished, see error
+};
+
+/// Kind of a transaction
+enum VFD_Transaction_Types : uint8_t {
+  VFD_TRANSACTION_READ = 0, ///< Reads consecutive registers
+  VFD_TRANSACTION_WRITE,  ///< Writes a single register
+  VFD_TRANSACTION_UPDATE, ///< Reads the polled registers of the drive, as VFD::update()
+};
+
+/**
+ * Owned by the caller and handed to VFDBus, which doesn't allocate anything: it must stay alive
+ * and untouched until done. The same transaction can be queued again once done.
+ * @brief Request to a drive and its result
+ */
+struct VFD_Transaction {
+  VFD* drive; ///< Drive the request is for
+  VFD_Transaction_Types type; ///< Kind of request
+  uint16_t start; ///< First register
+  uint8_t count;  ///< Number of registers
+  uint16_t* values; ///< Where read values are stored (NULL for a single read, stored in value)
+  uint16_t value; ///< Value read by a single register read, or value to write
+  volatile VFD_Transaction_States state;  ///< Where the transaction is
+  VFD_Comm_Errors error;  ///< Result, valid when done
+  uint32_t sent_us; ///< micros() the request was sent at
+  uint32_t done_us; ///< micros() the transaction was done at (response complete or timed out)
+  VFD_Transaction* next;  ///< Next queued transaction
+
+  /**
+     * @brief Constructor, of an idle transaction
+  */
+  VFD_Transaction();
+};
+
+
+/**
+ * Requests are queued and run one at a time by poll(), which never waits for the drive:
+ * call it from loop() as often as possible. Pending reads of the same drive are coalesced
+ * into a single request when cheaper, each transaction still gets its own registers; reads
+ * queued after a write are never joined to a read queued before it. Many drives (and tasks, see VFDTask.h) can share
+ * the line without blocking each other or the sketch.
+ * Don't call the blocking VFD methods on the same line while transactions are pending.
+ * @brief Non-blocking transaction queue of a RS485 line
+ */
+class VFDBus {
+  friend class VFD;
+
+  /// Settings of the line, shared with the drives built on the bus
+  VFD_Line line;
+
+  /// First queued transaction, the one on the line when sent
+  VFD_Transaction* head;
+
+  /// Last queued transaction
+  VFD_Transaction* tail;
+
+  /// Frame sent or being received
+  uint8_t frame[9+2*VFD_MAX_RANGE_REGISTERS];
+
+  /// Bytes received of the response
+  uint8_t received;
+
+  /// Length of a correct response
+  uint8_t expected;
+
+  /// First register of the request on the line
+  uint16_t active_start;
+
+  /// Number of registers of the request on the line
+  uint8_t active_count;
+
+  /// Number of reads coalesced into another request
+  uint16_t coalesced;
+
+  /// micros() of the last byte sent (or handed to the serial) or received, frames are separated by 3.5 chars of silence
+  uint32_t last_activity;
+
+  /// Time the request handed to the serial at last_activity takes to go out (0 if flushed or answered)
+  uint32_t tx_us;
+
+  /**
+     * @brief Adds a transaction to the queue
+     * @param t transaction, with drive, type, start, count and values set
+     * @return false if t is already queued
+  */
+  bool enqueue(VFD_Transaction& t);
+
+  /**
+     * Queued reads of the same drive are joined to the read on the line when the span
+     * covering them costs less than separate requests (see readCost()). The scan stops at the
+     * first queued write, so a read never overtakes a write queued before it.
+     * @brief Sets the request span of the first transaction
+  */
+  void coalesceHead();
+
+  /**
+     * @brief Builds and sends the request of the first queued transaction
+  */
+  void sendHead();
+
+  /**
+     * @brief Stores the result of a transaction answered by the received frame
+     * @param t transaction, unlinked from the queue
+     * @param error result of the request
+  */
+  void complete(VFD_Transaction* t, VFD_Comm_Errors error);
+
+  /**
+     * @brief Checks the response, stores the result and removes the transactions on the line from the queue
+  */
+  void completeHead();
+
+public:
+  /**
+     * @brief Constructor, for full-duplex adapters
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+     * @param _baud_rate communication baud (Param P03.00)
+  */
+  VFDBus(Stream& _comm_stream, uint32_t _baud_rate);
+
+  /**
+     * @brief Constructor.
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+     * @param _baud_rate communication baud (Param P03.00)
+     * @param _comm_pin Arduino pin for commutating trasmit/receive mode.
+  */
+  VFDBus(Stream& _comm_stream, uint32_t _baud_rate, uint8_t _comm_pin);
+
+  /**
+     * @brief First call for pin settings
+  */
+  void begin();
+
+  /**
+     * Only VFD_DIRECTION_DIGITAL and VFD_DIRECTION_PORT wait in flush() for the request to be out,
+     * with VFD_DIRECTION_TX_HOOK (txComplete() called by the serial TX complete interrupt, see the
+     * TxCompleteHook example) and auto-direction transceivers poll() returns as soon as the request
+     * is queued.
+     * @brief Sets how the half-duplex transceiver is switched, call it before begin()
+     * @param mode direction mode
+  */
+  void setDirectionMode(VFD_Direction_Modes mode);
+
+  /**
+     * Call it from the serial TX complete interrupt when using VFD_DIRECTION_TX_HOOK.
+     * @brief Switches the transceiver back to receive
+  */
+  void txComplete();
+
+  /**
+     * @brief Queues a read of consecutive registers
+     * @param t transaction to use
+     * @param drive drive to read from
+     * @param start first register
+     * @param count number of registers (at most VFD_MAX_RANGE_REGISTERS)
+     * @param values where read values are stored (at least count)
+     * @return false if t is already queued or count is out of range
+  */
+  bool read(VFD_Transaction& t, VFD& drive, uint16_t start, uint8_t count, uint16_t values[]);
+
+  /**
+     * @brief Queues a read of a single register, stored in t.value
+     * @param t transaction to use
+     * @param drive drive to read from
+     * @param r register to read
+     * @return false if t is already queued
+  */
+  bool read(VFD_Transaction& t, VFD& drive, uint16_t r);
+
+  /**
+     * @brief Queues a write of a single register
+     * @param t transaction to use
+     * @param drive drive to write to
+     * @param r register to write
+     * @param value value to write
+     * @return false if t is already queued
+  */
+  bool write(VFD_Transaction& t, VFD& drive, uint16_t r, uint16_t value);
+
+  /**
+     * Goes before every transaction not sent yet, for commands that can't wait behind polling.
+     * @brief Queues a write of a single register with priority
+     * @param t transaction to use
+     * @param drive drive to write to
+     * @param r register to write
+     * @param value value to write
+     * @return false if t is already queued
+  */
+  bool writeFirst(VFD_Transaction& t, VFD& drive, uint16_t r, uint16_t value);
+
+  /**
+     * When done the drive fetch methods return the new values, as after VFD::update().
+     * @brief Queues a read of the polled registers of a drive
+     * @param t transaction to use
+     * @param drive drive to update
+     * @return false if t is already queued
+  */
+  bool update(VFD_Transaction& t, VFD& drive);
+
+  /**
+     * Sends the next request when the line is free and collects the response as bytes arrive.
+     * @brief Runs the queue, never waits for the drive
+  */
+  void poll();
+
+  /**
+     * @brief Checks if a transaction is finished
+     * @param t transaction
+     * @return true if done (check t.error)
+  */
+  static bool done(const VFD_Transaction& t);
+
+  /**
+     * @brief Checks if there are transactions to run
+     * @return true if nothing is queued
+  */
+  bool idle();
+
+  /**
+     * Request and response at the line baud, the silence before each frame and VFD_TURNAROUND_US.
+     * @brief Estimated line time of a read request
+     * @param count number of registers read
+     * @return time in microseconds
+  */
+  uint32_t readCost(uint8_t count);
+
+  /**
+     * @brief Number of reads coalesced into another request since start
+     * @return number of requests saved on the line
+  */
+  uint16_t coalescedCount();
+
+  /**
+     * @brief Number of queued transactions
+     * @return number of transactions queued or on the line
+  */
+  uint8_t pending();
+};
+
+#endif  // _VFD_BUS_H_
@@ -0,0 +1,192 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Bus traffic capture and replay for YL-620 drives
+    @file VFDCapture.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDCapture.h"
+
+
+// VFDCapture
+
+// class constructor
+VFDCapture::VFDCapture(uint8_t* _buffer, uint16_t _size) {
+  buffer = _buffer;
+  size = _size;
+  dropped = 0;
+  clear();
+}
+
+// Writes a byte at head
+void VFDCapture::put(uint8_t b) {
+  buffer[head] = b;
+  head = (head + 1) % size;
+}
+
+// Records a frame
+void VFDCapture::record(VFD_Capture_Types type, const uint8_t* frame, uint8_t len) {
+  uint32_t now = VFD_MICROS();
+  uint16_t record_size = VFD_CAPTURE_RECORD_HEADER + len;
+  if(record_size > size) { // would never fit
+    dropped++;
+    return;
+  }
+
+  // make room dropping the oldest records
+  while(size - used < record_size) {
+    uint16_t old_size = VFD_CAPTURE_RECORD_HEADER + buffer[tail];
+    tail = (tail + old_size) % size;
+    used -= old_size;
+    records--;
+    dropped++;
+  }
+
+  put(len);
+  put(type);
+  put((uint8_t)(now >> 24));
+  put((uint8_t)(now >> 16));
+  put((uint8_t)(now >> 8));
+  put((uint8_t)now);
+  for(uint8_t i = 0; i < len; i++) put(frame[i]);
+
+  used += record_size;
+  records++;
+}
+
+// Number of records in the buffer
+uint16_t VFDCapture::count() {
+  return records;
+}
+
+// Number of records dropped
+uint16_t VFDCapture::droppedCount() {
+  return dropped;
+}
+
+// Removes all the records
+void VFDCapture::clear() {
+  head = tail = used = records = 0;
+}
+
+// Dumps the records, oldest first
+uint32_t VFDCapture::dump(Print& out) {
+  uint32_t written = out.write(VFD_CAPTURE_MAGIC);
+  written += out.write(VFD_CAPTURE_VERSION);
+
+  // records may wrap around the end of the buffer: write the two parts
+  uint16_t first_part = size - tail;
+  if(first_part > used) first_part = used;
+  written += out.write(buffer + tail, first_part);
+  written += out.write(buffer, used - first_part);
+  return written;
+}
+
+
+// VFDReplay
+
+// class constructor
+VFDReplay::VFDReplay(const uint8_t* _data, uint32_t _length) {
+  data = _data;
+  length = _length;
+  pos = VFD_CAPTURE_HEADER;
+  response = NULL;
+  response_len = response_pos = 0;
+  mismatches = 0;
+  timestamp = 0;
+}
+
+// Loads the next record of a type, skipping the others
+bool VFDReplay::next(VFD_Capture_Types type, const uint8_t** frame, uint8_t* len) {
+  while(pos + VFD_CAPTURE_RECORD_HEADER <= length) {
+    uint8_t record_len = data[pos];
+    uint8_t record_type = data[pos+1];
+    if(pos + VFD_CAPTURE_RECORD_HEADER + record_len > length) break; // truncated dump
+
+    uint32_t record_time = ((uint32_t)data[pos+2] << 24) | ((uint32_t)data[pos+3] << 16) | ((uint32_t)data[pos+4] << 8) | data[pos+5];
+    const uint8_t* record_frame = data + pos + VFD_CAPTURE_RECORD_HEADER;
+    pos += VFD_CAPTURE_RECORD_HEADER + record_len;
+
+    if(record_type != type) continue;
+    timestamp = record_time;
+    *frame = record_frame;
+    *len = record_len;
+    return true;
+  }
+  pos = length;
+  return false;
+}
+
+// Checks the dump header
+bool VFDReplay::valid() {
+  return length >= VFD_CAPTURE_HEADER && data[0] == VFD_CAPTURE_MAGIC && data[1] == VFD_CAPTURE_VERSION;
+}
+
+// Gets if all the records were played
+bool VFDReplay::finished() {
+  return pos >= length && response_pos >= response_len;
+}
+
+// Number of requests which differ from the captured ones
+uint16_t VFDReplay::mismatchCount() {
+  return mismatches;
+}
+
+// Timestamp of the last record played
+uint32_t VFDReplay::lastTimestamp() {
+  return timestamp;
+}
+
+int VFDReplay::available() {
+  return response_len - response_pos;
+}
+
+int VFDReplay::read() {
+  if(response_pos >= response_len) return -1;
+  return response[response_pos++];
+}
+
+int VFDReplay::peek() {
+  if(response_pos >= response_len) return -1;
+  return response[response_pos];
+}
+
+// A single byte is a request of its own
+size_t VFDReplay::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+// Compares the request with the next captured one and queues the captured response
+size_t VFDReplay::write(const uint8_t* buffer, size_t size) {
+  response_len = response_pos = 0;
+  const uint8_t* request;
+  uint8_t request_len;
+  if(!next(VFD_CAPTURE_REQUEST, &request, &request_len)) {
+    mismatches++; // more requests than captured
+    return size;
+  }
+  if(size != request_len || memcmp(buffer, request, size) != 0) mismatches++;
+
+  // the response captured right after the request is what the drive answered
+  if(pos + 1 < length && data[pos+1] == VFD_CAPTURE_RESPONSE) { // otherwise no answer was captured (timeout)
+    next(VFD_CAPTURE_RESPONSE, &response, &response_len);
+  }
+  return size;
+}
+
+void VFDReplay::flush() {
+}
@@ -0,0 +1,182 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Bus traffic capture and replay for YL-620 drives
+    @file VFDCapture.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_CAPTURE_H_
+#define _VFD_CAPTURE_H_
+
+#include "YL620-Arduino.h"
+
+/// First byte of a capture dump
+#define VFD_CAPTURE_MAGIC 0x56
+/// Format version of a capture dump
+#define VFD_CAPTURE_VERSION 1
+/// Size of the capture dump header (magic, version)
+#define VFD_CAPTURE_HEADER 2
+/// Size of the header of each record (length, type, 4 bytes timestamp)
+#define VFD_CAPTURE_RECORD_HEADER 6
+
+/// Type of a captured frame
+enum VFD_Capture_Types : uint8_t {
+  VFD_CAPTURE_REQUEST = 0,  ///< Frame sent to the drive
+  VFD_CAPTURE_RESPONSE = 1, ///< Bytes received from the drive (can be incomplete or corrupted)
+};
+
+
+/**
+ * Records are stored in a ring buffer given by the user: when full the oldest records are dropped.
+ * Each record is:
+ *  0 - frame length
+ *  1 - type (VFD_Capture_Types)
+ *  2..5 - micros() timestamp, MSB first
+ *  6.. - frame bytes
+ * @brief Captures the frames exchanged with drives
+ * @see VFD::setCapture()
+ */
+class VFDCapture {
+  uint8_t* buffer;  ///< Ring buffer
+  uint16_t size;  ///< Size of the ring buffer
+  uint16_t head;  ///< Where the next byte is written
+  uint16_t tail;  ///< First byte of the oldest record
+  uint16_t used;  ///< Bytes used in the ring buffer
+  uint16_t records; ///< Number of records in the buffer
+  uint16_t dropped; ///< Number of records dropped because the buffer was full
+
+  /**
+     * @brief Writes a byte at head
+     * @param b byte to write
+  */
+  void put(uint8_t b);
+
+public:
+  /**
+     * @brief Constructor.
+     * @param _buffer buffer for the records
+     * @param _size size of the buffer
+  */
+  VFDCapture(uint8_t* _buffer, uint16_t _size);
+
+  /**
+     * @brief Records a frame, called by the VFD class
+     * @param type request or response
+     * @param frame bytes of the frame
+     * @param len length of the frame
+  */
+  void record(VFD_Capture_Types type, const uint8_t* frame, uint8_t len);
+
+  /**
+     * @brief Number of records in the buffer
+     * @return number of records
+  */
+  uint16_t count();
+
+  /**
+     * @brief Number of records dropped because the buffer was full
+     * @return number of dropped records
+  */
+  uint16_t droppedCount();
+
+  /**
+     * @brief Removes all the records
+  */
+  void clear();
+
+  /**
+     * Writes the capture header and all the records, oldest first, as binary.
+     * Use Serial to send it to a PC, or a File to save it, then replay it with VFDReplay.
+     * @brief Dumps the records
+     * @param out where to write the dump
+     * @return number of bytes written
+  */
+  uint32_t dump(Print& out);
+};
+
+
+/**
+ * Plays the responses of a capture dump back to a VFD object: each request written is compared with
+ * the captured one and answered with the captured response, without delays, so failures can be
+ * reproduced offline going through the same parsing and update() decoding.
+ * Every write() call is a request, as the library writes a frame in a single call: a request
+ * longer or shorter than the captured one is a mismatch, and the replay stays in step.
+ * @brief Stream replaying a capture
+ */
+class VFDReplay : public Stream {
+  const uint8_t* data;  ///< Capture dump
+  uint32_t length;  ///< Length of the dump
+  uint32_t pos; ///< Next record to play
+
+  const uint8_t* response;  ///< Captured response being read
+  uint8_t response_len; ///< Length of the captured response
+  uint8_t response_pos; ///< Bytes of the response read so far
+
+  uint16_t mismatches;  ///< Requests which differ from the captured ones
+  uint32_t timestamp; ///< Timestamp of the last record played
+
+  /**
+     * @brief Loads the next record of a type
+     * @param type type of the record
+     * @param frame will point to the frame
+     * @param len will contain the length of the frame
+     * @return true if found
+  */
+  bool next(VFD_Capture_Types type, const uint8_t** frame, uint8_t* len);
+
+public:
+  /**
+     * @brief Constructor.
+     * @param _data capture dump (as written by VFDCapture::dump())
+     * @param _length length of the dump
+  */
+  VFDReplay(const uint8_t* _data, uint32_t _length);
+
+  /**
+     * @brief Checks the dump header
+     * @return true if the dump is a capture of a known version
+  */
+  bool valid();
+
+  /**
+     * @brief Gets if all the records were played
+     * @return true if finished
+  */
+  bool finished();
+
+  /**
+     * @brief Number of requests which differ from the captured ones
+     * @return number of mismatches
+  */
+  uint16_t mismatchCount();
+
+  /**
+     * @brief Timestamp of the last record played
+     * @return captured micros()
+  */
+  uint32_t lastTimestamp();
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* buffer, size_t size);
+  using Print::write;
+  void flush();
+};
+
+#endif  // _VFD_CAPTURE_H_
@@ -0,0 +1,114 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Transmit/receive switching of half-duplex RS485 transceivers
+    @file VFDDirection.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDDirection.h"
+
+
+// Private methods
+
+// Sets the pin level
+void VFDDirection::write(uint8_t level) {
+#ifdef portOutputRegister
+  if(mode != VFD_DIRECTION_DIGITAL && port != NULL) { // resolved at begin(), a single read-modify-write
+  #ifdef SREG
+    uint8_t old_sreg = SREG;  // as digitalWrite(), an interrupt mustn't change the port in between
+    cli();
+  #endif
+    if(level == HIGH) *port |= mask;
+    else *port &= ~mask;
+  #ifdef SREG
+    SREG = old_sreg;
+  #endif
+    return;
+  }
+#endif
+  digitalWrite(pin, level);
+}
+
+
+// Public methods
+
+// class constructor(s)
+VFDDirection::VFDDirection() {
+  pin = 0;
+  has_pin = false;
+  mode = VFD_DIRECTION_AUTO;
+#ifdef portOutputRegister
+  port = NULL;
+  mask = 0;
+#endif
+}
+VFDDirection::VFDDirection(uint8_t _pin) {
+  pin = _pin;
+  has_pin = true;
+  mode = VFD_DIRECTION_DIGITAL;
+#ifdef portOutputRegister
+  port = NULL;
+  mask = 0;
+#endif
+}
+
+// Sets how the transceiver is switched
+void VFDDirection::setMode(VFD_Direction_Modes _mode) {
+  if(!has_pin) return;  // no pin to switch
+  mode = _mode;
+}
+
+// Direction mode in use
+VFD_Direction_Modes VFDDirection::getMode() {
+  return mode;
+}
+
+// Checks if a pin was given
+bool VFDDirection::hasPin() {
+  return has_pin;
+}
+
+// Sets the pin as output, in receive mode
+void VFDDirection::begin() {
+  if(!has_pin) return;
+  pinMode(pin, OUTPUT);
+#ifdef portOutputRegister
+  port = portOutputRegister(digitalPinToPort(pin));
+  mask = digitalPinToBitMask(pin);
+#endif
+  digitalWrite(pin, CP_RECEIVE_LEVEL);
+}
+
+// Switches to transmit
+void VFDDirection::transmit() {
+  if(mode != VFD_DIRECTION_AUTO) write(CP_TRANSMIT_LEVEL);
+}
+
+// Checks if flush() must be waited before release()
+bool VFDDirection::needsFlush() {
+  return mode == VFD_DIRECTION_DIGITAL || mode == VFD_DIRECTION_PORT;
+}
+
+// Switches back to receive
+void VFDDirection::release() {
+  if(mode != VFD_DIRECTION_AUTO) write(CP_RECEIVE_LEVEL);
+}
+
+// End of transmission hook
+void VFDDirection::txComplete() {
+  if(mode == VFD_DIRECTION_TX_HOOK) write(CP_RECEIVE_LEVEL);
+}
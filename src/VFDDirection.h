@@ -0,0 +1,133 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Transmit/receive switching of half-duplex RS485 transceivers
+    @file VFDDirection.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_DIRECTION_H_
+#define _VFD_DIRECTION_H_
+
+#include <Arduino.h>
+
+/// Pin level of transmit mode
+#define CP_TRANSMIT_LEVEL HIGH
+/// Pin level of receive mode
+#define CP_RECEIVE_LEVEL  LOW
+
+/// How the transceiver is switched between transmit and receive
+enum VFD_Direction_Modes : uint8_t {
+  VFD_DIRECTION_AUTO = 0, ///< Auto-direction or full-duplex transceiver, no pin
+  VFD_DIRECTION_DIGITAL,  ///< digitalWrite() on the pin, back to receive after flush() (default with a pin)
+  VFD_DIRECTION_PORT, ///< Direct port register write, resolved at begin() (digitalWrite() where the core has no port access)
+  VFD_DIRECTION_TX_HOOK,  ///< Port write to transmit, txComplete() (es. called by the TX complete interrupt) back to receive
+};
+
+
+/**
+ * Back to receive mode must happen right after the last stop bit: the drive starts answering
+ * soon after. digitalWrite() takes some microseconds on AVR, a port write a single instruction,
+ * and with the TX complete hook nobody waits in flush() at all.
+ * @brief Direction control of a half-duplex transceiver
+ */
+class VFDDirection {
+#ifdef portOutputRegister
+  /// Output register of the pin port, resolved at begin() (NULL before)
+  decltype(portOutputRegister(digitalPinToPort(0))) port;
+
+  /// Bit of the pin in its port
+  decltype(digitalPinToBitMask(0)) mask;
+#endif
+
+  /// Arduino pin of the transceiver DE/RE
+  uint8_t pin;
+
+  /// A pin was given: modes switching it can be set
+  bool has_pin;
+
+  /// How the pin is switched
+  VFD_Direction_Modes mode;
+
+  /**
+     * @brief Sets the pin level
+     * @param level CP_TRANSMIT_LEVEL or CP_RECEIVE_LEVEL
+  */
+  void write(uint8_t level);
+
+public:
+  /**
+     * @brief Constructor, for auto-direction or full-duplex transceivers
+  */
+  VFDDirection();
+
+  /**
+     * @brief Constructor, digitalWrite() on a pin
+     * @param _pin Arduino pin for commutating trasmit/receive mode
+  */
+  VFDDirection(uint8_t _pin);
+
+  /**
+     * Call it before begin(): port writes start only once begin() resolved the port.
+     * Modes with a pin are ignored without one.
+     * @brief Sets how the transceiver is switched
+     * @param _mode direction mode
+  */
+  void setMode(VFD_Direction_Modes _mode);
+
+  /**
+     * @brief Direction mode in use
+     * @return direction mode
+  */
+  VFD_Direction_Modes getMode();
+
+  /**
+     * @brief Checks if a pin was given
+     * @return true if the transceiver has a DE/RE pin
+  */
+  bool hasPin();
+
+  /**
+     * @brief Sets the pin as output, in receive mode
+  */
+  void begin();
+
+  /**
+     * @brief Switches to transmit
+  */
+  void transmit();
+
+  /**
+     * @brief Checks if flush() must be waited before release()
+     * @return true if the pin is released by release() after flush()
+  */
+  bool needsFlush();
+
+  /**
+     * With VFD_DIRECTION_TX_HOOK too, in case the hook already did it this is harmless.
+     * @brief Switches back to receive, when the last byte is out (after flush())
+  */
+  void release();
+
+  /**
+     * Call it from the serial TX complete interrupt (or wherever the end of transmission is known):
+     * with VFD_DIRECTION_TX_HOOK it switches back to receive, otherwise it does nothing.
+     * @brief End of transmission hook
+  */
+  void txComplete();
+};
+
+#endif  // _VFD_DIRECTION_H_
@@ -0,0 +1,219 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Modbus TCP front-end for the drives of a RS485 line
+    @file VFDGateway.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDGateway.h"
+
+
+// Private methods
+
+// Finds a drive by unit id
+uint8_t VFDGateway::findDrive(uint8_t unit_id) {
+  uint8_t i = 0;
+  while(i < num_drives && unit_ids[i] != unit_id) i++;
+  return i;
+}
+
+// Checks if the mirror of a drive can be served
+bool VFDGateway::cacheValid(uint8_t i) {
+  // while an update is on its way the result of the previous one holds
+  if(VFDBus::done(updates[i])) cache_valid[i] = updates[i].error == VFD_COMM_SUCCESS;
+  return cache_valid[i];
+}
+
+// Starts serving a complete request
+void VFDGateway::handleRequest(VFD_GatewayClient& c, Stream& connection) {
+  // request format (after the 7 bytes header):
+  //  7. function
+  //  8. register address high
+  //  9. register address low
+  //  10. number of registers (or value to write) high
+  //  11. number of registers (or value to write) low
+  uint8_t i = findDrive(c.request[6]);
+  if(i == num_drives) {
+    answerException(c, connection, VFD_GATEWAY_PATH_UNAVAILABLE);
+    return;
+  }
+  uint16_t address = (c.request[8] << 8) | c.request[9];
+  uint16_t value = (c.request[10] << 8) | c.request[11];
+
+  if(c.request[7] == 0x06) { // writes can't wait behind polling
+    if(!bus->writeFirst(c.t, *drives[i], address, value)) {
+      answerException(c, connection, VFD_GATEWAY_DEVICE_BUSY);
+      return;
+    }
+    c.busy = true;
+    return;
+  }
+
+  if(value == 0 || value > VFD_MAX_RANGE_REGISTERS) {
+    answerException(c, connection, VFD_GATEWAY_ILLEGAL_VALUE);
+    return;
+  }
+
+  // hot registers come from the mirror, the line isn't touched
+  if(cacheValid(i)) {
+    uint8_t n = 0;
+    while(n < value && drives[i]->fetchPolled(address + n, &c.values[n])) n++;
+    if(n == value) {
+      answerRead(c, connection, c.values, n);
+      return;
+    }
+  }
+
+  if(!bus->read(c.t, *drives[i], address, value, c.values)) {
+    answerException(c, connection, VFD_GATEWAY_DEVICE_BUSY);
+    return;
+  }
+  c.busy = true;
+}
+
+// Sends the answer of a forwarded request
+void VFDGateway::answerForwarded(VFD_GatewayClient& c, Stream& connection) {
+  if(c.t.error == VFD_COMM_ERROR_EXCEPTION) {
+    answerException(c, connection, VFD_GATEWAY_DEVICE_FAILURE);
+  }
+  else if(c.t.error != VFD_COMM_SUCCESS) {
+    answerException(c, connection, VFD_GATEWAY_TARGET_FAILED);
+  }
+  else if(c.request[7] == 0x06) { // write answer is an echo of the request
+    connection.write(c.request, VFD_MBAP_REQUEST);
+  }
+  else {
+    answerRead(c, connection, c.values, c.t.count);
+  }
+}
+
+// Sends a read answer
+void VFDGateway::answerRead(const VFD_GatewayClient& c, Stream& connection, const uint16_t values[], uint8_t count) {
+  // answer format:
+  //  0-3. transaction and protocol id, as the request
+  //  4-5. length of what follows (unit id, function, byte count, data)
+  //  6. unit id
+  //  7. function
+  //  8. byte count
+  //  n - Data High
+  //  n+1 - Data Low
+  uint8_t answer[VFD_MBAP_HEADER+2+2*VFD_MAX_RANGE_REGISTERS];
+  memcpy(answer, c.request, 4);
+  answer[4] = 0;
+  answer[5] = 3+2*count;
+  answer[6] = c.request[6];
+  answer[7] = c.request[7];
+  answer[8] = 2*count;
+  for(uint8_t i = 0; i < count; i++) {
+    answer[9+2*i] = (uint8_t)(values[i] >> 8);
+    answer[10+2*i] = (uint8_t)values[i];
+  }
+  connection.write(answer, VFD_MBAP_HEADER+2+2*count);
+}
+
+// Sends an exception answer
+void VFDGateway::answerException(const VFD_GatewayClient& c, Stream& connection, VFD_Gateway_Exceptions code) {
+  uint8_t answer[VFD_MBAP_HEADER+2] = {c.request[0], c.request[1], c.request[2], c.request[3], 0, 3,
+    c.request[6], (uint8_t)(c.request[7] | 0x80), code};
+  connection.write(answer, VFD_MBAP_HEADER+2);
+}
+
+
+// Public methods
+
+// class constructor
+VFD_GatewayClient::VFD_GatewayClient() {
+  received = 0;
+  skip = 0;
+  busy = discard = false;
+}
+
+// class constructor
+VFDGateway::VFDGateway(VFDBus& _bus) {
+  bus = &_bus;
+  num_drives = 0;
+  poll_interval = VFD_GATEWAY_POLL_INTERVAL;
+}
+
+// Serves a drive to the clients
+bool VFDGateway::addDrive(uint8_t unit_id, VFD& drive) {
+  if(num_drives >= VFD_GATEWAY_MAX_DRIVES) return false;
+  drives[num_drives] = &drive;
+  unit_ids[num_drives] = unit_id;
+  cache_valid[num_drives] = false;
+  polled_at[num_drives] = VFD_MILLIS() - poll_interval; // first update as soon as possible
+  num_drives++;
+  return true;
+}
+
+// Sets how often each drive is updated
+void VFDGateway::setPollInterval(uint16_t ms) {
+  poll_interval = ms;
+}
+
+// Queues the updates of the drives when due
+void VFDGateway::poll() {
+  for(uint8_t i = 0; i < num_drives; i++) {
+    if(updates[i].state == VFD_TRANSACTION_QUEUED || updates[i].state == VFD_TRANSACTION_SENT) continue;
+    if(VFD_MILLIS() - polled_at[i] < poll_interval) continue;
+    cacheValid(i); // keep the result before reusing the transaction
+    bus->update(updates[i], *drives[i]);
+    polled_at[i] = VFD_MILLIS();
+  }
+}
+
+// Receives the requests of a client and sends the answers
+void VFDGateway::serve(VFD_GatewayClient& c, Stream& connection) {
+  if(c.busy) {
+    if(!VFDBus::done(c.t)) return;
+    if(!c.discard) answerForwarded(c, connection);
+    c.busy = c.discard = false;
+  }
+
+  while(!c.busy && connection.available()) {
+    uint8_t b = connection.read();
+    if(c.skip > 0) { // rest of an unsupported request, its header is kept to answer it
+      if(--c.skip == 0) answerException(c, connection, VFD_GATEWAY_ILLEGAL_FUNCTION);
+      continue;
+    }
+
+    c.request[c.received++] = b;
+    if(c.received == VFD_MBAP_HEADER+1) { // header and function: we know what's coming
+      uint16_t length = (c.request[4] << 8) | c.request[5]; // unit id and what follows
+      uint8_t function = c.request[7];
+      bool supported = c.request[2] == 0 && c.request[3] == 0 && length == VFD_MBAP_REQUEST-6
+        && (function == 0x03 || function == 0x04 || function == 0x06);
+      if(!supported) {
+        c.received = 0;
+        if(length < 2 || length > 254) continue;  // not a Modbus TCP request, drop it
+        c.skip = length - 2;
+        if(c.skip == 0) answerException(c, connection, VFD_GATEWAY_ILLEGAL_FUNCTION);
+      }
+    }
+    else if(c.received == VFD_MBAP_REQUEST) {
+      c.received = 0;
+      handleRequest(c, connection);
+    }
+  }
+}
+
+// Resets a client state
+void VFDGateway::reset(VFD_GatewayClient& c) {
+  c.received = 0;
+  c.skip = 0;
+  c.discard = c.busy;
+}
@@ -0,0 +1,193 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Modbus TCP front-end for the drives of a RS485 line
+    @file VFDGateway.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_GATEWAY_H_
+#define _VFD_GATEWAY_H_
+
+#include "VFDBus.h"
+
+#ifndef VFD_GATEWAY_MAX_DRIVES
+  /// Max number of drives served by a gateway
+  #define VFD_GATEWAY_MAX_DRIVES 8
+#endif
+
+#ifndef VFD_GATEWAY_POLL_INTERVAL
+  /// Default time between updates of each drive, in ms
+  #define VFD_GATEWAY_POLL_INTERVAL 200
+#endif
+
+/// Size of the Modbus TCP header (transaction id, protocol id, length, unit id)
+#define VFD_MBAP_HEADER 7
+/// Size of the supported Modbus TCP requests (header, function, address, count or value)
+#define VFD_MBAP_REQUEST 12
+
+/// Modbus exception codes answered by the gateway
+enum VFD_Gateway_Exceptions : uint8_t {
+  VFD_GATEWAY_ILLEGAL_FUNCTION = 0x01,  ///< Function not supported
+  VFD_GATEWAY_ILLEGAL_VALUE = 0x03, ///< Register count out of range
+  VFD_GATEWAY_DEVICE_FAILURE = 0x04,  ///< Drive refused the request
+  VFD_GATEWAY_DEVICE_BUSY = 0x06, ///< The bus didn't queue the request
+  VFD_GATEWAY_PATH_UNAVAILABLE = 0x0A,  ///< No drive with the requested unit id
+  VFD_GATEWAY_TARGET_FAILED = 0x0B, ///< Drive didn't answer
+};
+
+/**
+ * One for each connected client, owned by the caller (es. next to its EthernetClient).
+ * @brief Connection state of a Modbus TCP client
+ */
+struct VFD_GatewayClient {
+  uint8_t request[VFD_MBAP_REQUEST];  ///< Request being received
+  uint8_t received; ///< Bytes received of the request
+  uint16_t skip;  ///< Bytes of an unsupported request still to discard
+  bool busy;  ///< Waiting for the drive to answer the request
+  bool discard; ///< The answer of the pending request is dropped (client reset)
+  VFD_Transaction t;  ///< Transaction forwarding the request to the drive
+  uint16_t values[VFD_MAX_RANGE_REGISTERS]; ///< Registers read for the client
+
+  /**
+     * @brief Constructor, of a client with nothing received yet
+  */
+  VFD_GatewayClient();
+};
+
+
+/**
+ * Clients are served without blocking: reads of registers polled by update() are answered
+ * from the drive mirror, refreshed by the gateway itself, without touching the line.
+ * Any other read, and writes, are forwarded to the drive as VFDBus transactions,
+ * writes before everything else queued.
+ * Supports read holding/input registers (3, 4) and write single register (6).
+ * @brief Serves the drives of a line to Modbus TCP clients
+ */
+class VFDGateway {
+  /// Line the drives are on
+  VFDBus* bus;
+
+  /// Drives served
+  VFD* drives[VFD_GATEWAY_MAX_DRIVES];
+
+  /// Modbus TCP unit id of each drive
+  uint8_t unit_ids[VFD_GATEWAY_MAX_DRIVES];
+
+  /// Update transaction of each drive
+  VFD_Transaction updates[VFD_GATEWAY_MAX_DRIVES];
+
+  /// millis() of the last update request of each drive
+  uint32_t polled_at[VFD_GATEWAY_MAX_DRIVES];
+
+  /// The last update of each drive succeeded, its mirror can be served
+  bool cache_valid[VFD_GATEWAY_MAX_DRIVES];
+
+  /// Number of drives served
+  uint8_t num_drives;
+
+  /// Time between updates of each drive, in ms
+  uint16_t poll_interval;
+
+  /**
+     * @brief Finds a drive by unit id
+     * @param unit_id Modbus TCP unit id
+     * @return position in drives, num_drives if not found
+  */
+  uint8_t findDrive(uint8_t unit_id);
+
+  /**
+     * @brief Checks if the mirror of a drive can be served
+     * @param i position in drives
+     * @return true if the last update succeeded
+  */
+  bool cacheValid(uint8_t i);
+
+  /**
+     * @brief Starts serving a complete request, answering it at once if possible
+     * @param c client
+     * @param connection where the answer is sent
+  */
+  void handleRequest(VFD_GatewayClient& c, Stream& connection);
+
+  /**
+     * @brief Sends the answer of a forwarded request
+     * @param c client
+     * @param connection where the answer is sent
+  */
+  void answerForwarded(VFD_GatewayClient& c, Stream& connection);
+
+  /**
+     * @brief Sends a read answer
+     * @param c client, with the request
+     * @param connection where the answer is sent
+     * @param values registers read
+     * @param count number of registers
+  */
+  static void answerRead(const VFD_GatewayClient& c, Stream& connection, const uint16_t values[], uint8_t count);
+
+  /**
+     * @brief Sends an exception answer
+     * @param c client, with the request
+     * @param connection where the answer is sent
+     * @param code exception code
+  */
+  static void answerException(const VFD_GatewayClient& c, Stream& connection, VFD_Gateway_Exceptions code);
+
+public:
+  /**
+     * @brief Constructor
+     * @param _bus line the drives are on
+  */
+  VFDGateway(VFDBus& _bus);
+
+  /**
+     * @brief Serves a drive to the clients
+     * @param unit_id Modbus TCP unit id of the drive (usually its MODBUS address)
+     * @param drive drive
+     * @return false if VFD_GATEWAY_MAX_DRIVES drives are already served
+  */
+  bool addDrive(uint8_t unit_id, VFD& drive);
+
+  /**
+     * @brief Sets how often each drive is updated (default VFD_GATEWAY_POLL_INTERVAL)
+     * @param ms time between updates of each drive
+  */
+  void setPollInterval(uint16_t ms);
+
+  /**
+     * Call from loop(), together with VFDBus::poll().
+     * @brief Queues the updates of the drives when due
+  */
+  void poll();
+
+  /**
+     * Call from loop() for every connected client, never waits for the drive.
+     * @brief Receives the requests of a client and sends the answers
+     * @param c client state
+     * @param connection connection of the client (es. EthernetClient)
+  */
+  void serve(VFD_GatewayClient& c, Stream& connection);
+
+  /**
+     * Drops a half received request, call it when a client disconnects before reusing c.
+     * @brief Resets a client state
+     * @param c client state
+  */
+  void reset(VFD_GatewayClient& c);
+};
+
+#endif  // _VFD_GATEWAY_H_
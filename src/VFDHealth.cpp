@@ -0,0 +1,148 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Health monitor of a YL-620 drive, fed by the polled registers
+    @file VFDHealth.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDHealth.h"
+
+
+// class constructor
+VFDHealth::VFDHealth(VFD& drive) {
+  vfd = &drive;
+  current_limit = 0;
+  fast_interval = 50;
+  slow_interval = 1000;
+  reset();
+}
+
+// Sets the current the drive trips at
+void VFDHealth::setCurrentLimit(uint16_t raw) {
+  current_limit = raw;
+}
+
+// Sets the range of the suggested poll interval
+void VFDHealth::setPollIntervals(uint16_t fast_ms, uint16_t slow_ms) {
+  fast_interval = fast_ms;
+  slow_interval = slow_ms;
+  interval = fast_ms;
+}
+
+// Checks the last update of the drive
+uint8_t VFDHealth::check(VFD_Comm_Errors result) {
+  bool failed = result != VFD_COMM_SUCCESS;
+  error_rate = error_rate - (error_rate >> 3) + (failed ? 31 : 0); // settles at 248 if every poll fails
+
+  // a failed poll brings no data: what was found on the last data holds
+  uint8_t found = flags & ~VFD_HEALTH_COMM_ERRORS;
+  if(!failed) {
+    found = VFD_HEALTH_OK;
+    uint16_t current = vfd->fetchOutCurrent();
+    uint16_t bus = vfd->fetchBusVoltage();
+    uint16_t aim = vfd->fetchAimFrequencyDeciHz();
+    uint16_t run = vfd->fetchRunFrequencyDeciHz();
+    uint16_t lag = aim > run ? aim - run : run - aim;
+
+    uint32_t now = vfd->fetchResponseTime();
+
+    if(!has_sample) { // averages start from the first sample
+      current_avg = (uint32_t)current * 8;
+      bus_avg = (uint32_t)bus * 8;
+      last_aim = aim;
+      best_lag = lag;
+      progress_us = now;
+      has_sample = true;
+    }
+
+    // averages are x8: compare value * 8 * 100 with average * percent
+    if(vfd->fetchAtSpeed() && (uint32_t)current*800 > current_avg*(100+VFD_HEALTH_SPIKE_PERCENT)) {
+      found |= VFD_HEALTH_CURRENT_SPIKE; // accelerating takes current, only a steady frequency counts
+    }
+    if(current_limit != 0 && (uint32_t)current*100 > (uint32_t)current_limit*VFD_HEALTH_LIMIT_PERCENT) {
+      found |= VFD_HEALTH_CURRENT_LIMIT;
+    }
+    if((uint32_t)bus*800 < bus_avg*(100-VFD_HEALTH_SAG_PERCENT)) {
+      found |= VFD_HEALTH_VOLTAGE_SAG;
+    }
+
+    // a ramp must get closer to the aim frequency within VFD_HEALTH_STALL_MS, a new aim starts a new ramp
+    if(!vfd->fetchRunning() || lag == 0 || aim != last_aim || lag < best_lag) {
+      best_lag = lag;
+      progress_us = now;
+    }
+    else if(now - progress_us >= VFD_HEALTH_STALL_MS*1000UL) {
+      progress_us = now - VFD_HEALTH_STALL_MS*1000UL; // stays stalled, however long it lasts
+      found |= VFD_HEALTH_RAMP_STALL;
+    }
+    last_aim = aim;
+
+    if(vfd->fetchError() != VFD_ERROR_NO_ERROR) found |= VFD_HEALTH_DRIVE_FAULT;
+
+    // averages move after the checks, so a spike is compared to what came before it
+    current_avg = current_avg - (current_avg >> 3) + current;
+    bus_avg = bus_avg - (bus_avg >> 3) + bus;
+  }
+  if(error_rate > VFD_HEALTH_ERROR_RATE) found |= VFD_HEALTH_COMM_ERRORS;
+  flags = found;
+
+  // poll faster at once when something looks wrong, slow down gradually when all is fine
+  if(flags != VFD_HEALTH_OK) interval = fast_interval;
+  else interval = interval > slow_interval / 2 ? slow_interval : interval * 2;
+  return flags;
+}
+
+// Anomalies found by the last check
+uint8_t VFDHealth::getFlags() {
+  return flags;
+}
+
+// Checks if the drive looks healthy
+bool VFDHealth::isHealthy() {
+  return flags == VFD_HEALTH_OK;
+}
+
+// Suggested time before the next update of the drive
+uint16_t VFDHealth::getPollInterval() {
+  return interval;
+}
+
+// Average of failed polls
+uint8_t VFDHealth::getErrorRate() {
+  return error_rate;
+}
+
+// Average out current
+uint16_t VFDHealth::getCurrentAverage() {
+  return current_avg >> 3;
+}
+
+// Average bus voltage
+uint16_t VFDHealth::getBusAverage() {
+  return bus_avg >> 3;
+}
+
+// Forgets averages and anomalies
+void VFDHealth::reset() {
+  current_avg = bus_avg = 0;
+  error_rate = 0;
+  last_aim = best_lag = 0;
+  progress_us = 0;
+  flags = VFD_HEALTH_OK;
+  has_sample = false;
+  interval = fast_interval;
+}
@@ -0,0 +1,160 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Health monitor of a YL-620 drive, fed by the polled registers
+    @file VFDHealth.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_HEALTH_H_
+#define _VFD_HEALTH_H_
+
+#include "YL620-Arduino.h"
+
+#ifndef VFD_HEALTH_SPIKE_PERCENT
+  /// Current above its average by this percent, at steady frequency, is a spike
+  #define VFD_HEALTH_SPIKE_PERCENT 50
+#endif
+
+#ifndef VFD_HEALTH_LIMIT_PERCENT
+  /// Current above this percent of the current limit is a warning (before VFD_ERROR_GREAT_CURRENT trips)
+  #define VFD_HEALTH_LIMIT_PERCENT 90
+#endif
+
+#ifndef VFD_HEALTH_SAG_PERCENT
+  /// Bus voltage below its average by this percent is a sag
+  #define VFD_HEALTH_SAG_PERCENT 10
+#endif
+
+#ifndef VFD_HEALTH_ERROR_RATE
+  /// Failed polls rate (0 - 255) above which communication is unhealthy (64 = 25%)
+  #define VFD_HEALTH_ERROR_RATE 64
+#endif
+
+#ifndef VFD_HEALTH_STALL_MS
+  /// Time the run frequency doesn't get closer to the aim frequency before a ramp stall, in ms.
+  /// Keep it longer than a 0.1Hz step of the slowest ramp: polls within a step see the same frequency.
+  #define VFD_HEALTH_STALL_MS 1000
+#endif
+
+/// Anomalies found by VFDHealth, as bits
+enum VFD_Health_Flags : uint8_t {
+  VFD_HEALTH_OK = 0,  ///< Nothing wrong
+  VFD_HEALTH_CURRENT_SPIKE = 0x01,  ///< Current jumped at steady frequency (load jam)
+  VFD_HEALTH_CURRENT_LIMIT = 0x02,  ///< Current close to the limit
+  VFD_HEALTH_VOLTAGE_SAG = 0x04,  ///< Bus voltage dropped
+  VFD_HEALTH_COMM_ERRORS = 0x08,  ///< Too many failed polls
+  VFD_HEALTH_RAMP_STALL = 0x10, ///< Run frequency isn't reaching the aim frequency
+  VFD_HEALTH_DRIVE_FAULT = 0x20,  ///< The drive reports an error
+};
+
+
+/**
+ * Call check() after each update of the drive (VFD::update() or a VFDBus update transaction):
+ * anomalies are found on the data already polled, with no additional request, at the poll they show up.
+ * Averages are exponential, each poll weighs 1/8.
+ * The suggested poll interval gets short as soon as the drive looks unhealthy,
+ * and backs off while it stays healthy.
+ * @brief Health monitor of a drive
+ */
+class VFDHealth {
+  /// Drive monitored
+  VFD* vfd;
+
+  uint32_t current_avg; ///< Average out current (raw x8)
+  uint32_t bus_avg; ///< Average bus voltage (raw x8)
+  uint8_t error_rate; ///< Average of failed polls (0 - 255)
+  uint16_t last_aim;  ///< Aim frequency of the last poll (0.1Hz)
+  uint16_t best_lag;  ///< Smallest distance between aim and run frequency of this ramp (0.1Hz)
+  uint32_t progress_us; ///< Response time of the poll the lag last shrank at
+  uint8_t flags;  ///< Anomalies of last check (VFD_Health_Flags)
+  bool has_sample;  ///< Averages hold data
+
+  uint16_t current_limit; ///< Current limit, raw as the out current register (0 = not checked)
+  uint16_t fast_interval; ///< Poll interval when unhealthy, in ms
+  uint16_t slow_interval; ///< Max poll interval when healthy, in ms
+  uint16_t interval;  ///< Suggested poll interval, in ms
+
+public:
+  /**
+     * @brief Constructor
+     * @param drive drive to monitor
+  */
+  VFDHealth(VFD& drive);
+
+  /**
+     * @brief Sets the current the drive trips at, raw as fetchOutCurrent() (default 0, not checked)
+     * @param raw current limit
+  */
+  void setCurrentLimit(uint16_t raw);
+
+  /**
+     * @brief Sets the range of the suggested poll interval (default 50 - 1000ms)
+     * @param fast_ms interval when unhealthy
+     * @param slow_ms max interval when healthy
+  */
+  void setPollIntervals(uint16_t fast_ms, uint16_t slow_ms);
+
+  /**
+     * @brief Checks the last update of the drive
+     * @param result result of the update
+     * @return anomalies found (VFD_Health_Flags bits)
+  */
+  uint8_t check(VFD_Comm_Errors result);
+
+  /**
+     * @brief Anomalies found by the last check
+     * @return VFD_Health_Flags bits
+  */
+  uint8_t getFlags();
+
+  /**
+     * @brief Checks if the drive looks healthy
+     * @return true if no anomaly
+  */
+  bool isHealthy();
+
+  /**
+     * @brief Suggested time before the next update of the drive
+     * @return interval in ms
+  */
+  uint16_t getPollInterval();
+
+  /**
+     * @brief Average of failed polls
+     * @return rate, 0 (none) - 255 (all)
+  */
+  uint8_t getErrorRate();
+
+  /**
+     * @brief Average out current
+     * @return raw current, as fetchOutCurrent()
+  */
+  uint16_t getCurrentAverage();
+
+  /**
+     * @brief Average bus voltage
+     * @return raw voltage, as fetchBusVoltage()
+  */
+  uint16_t getBusAverage();
+
+  /**
+     * @brief Forgets averages and anomalies (es. after replacing the motor)
+  */
+  void reset();
+};
+
+#endif  // _VFD_HEALTH_H_
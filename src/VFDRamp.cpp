@@ -0,0 +1,175 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Frequency ramp generator for YL-620 drives
+    @file VFDRamp.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDRamp.h"
+
+
+// Private methods
+
+// Gets the profile fraction at a progress
+uint16_t VFDRamp::shape(uint16_t progress) {
+  switch(profile) {
+    case VFD_RAMP_S_CURVE: {
+      // smoothstep: x^2 * (3 - 2x), all in VFD_RAMP_ONE fixed point
+      // divided only at the end so it stays monotonic (max 1024^2 * 3072 fits 32 bit)
+      uint32_t x = progress;
+      return (uint16_t)(x * x * (3UL*VFD_RAMP_ONE - 2*x) / ((uint32_t)VFD_RAMP_ONE * VFD_RAMP_ONE));
+    }
+    case VFD_RAMP_CUSTOM: {
+      uint16_t fraction = custom_profile(progress);
+      return fraction > VFD_RAMP_ONE ? VFD_RAMP_ONE : fraction;
+    }
+    default:
+      return progress;
+  }
+}
+
+
+// Public methods
+
+// class constructor
+VFDRamp::VFDRamp(VFD& _vfd) {
+  vfd = &_vfd;
+  interval = VFD_RAMP_INTERVAL;
+  profile = VFD_RAMP_S_CURVE;
+  custom_profile = NULL;
+  lag_every = 4;
+  sent_count = 0;
+  lag = 0;
+  max_lag = 0;
+  setpoint = sent_freq = 0;
+  has_setpoint = active = false;
+}
+
+// Sets the min time between two setpoints
+void VFDRamp::setUpdateInterval(uint16_t ms) {
+  interval = ms;
+}
+
+// Sets the ramp profile
+void VFDRamp::setProfile(VFD_Ramp_Profiles _profile) {
+  if(_profile == VFD_RAMP_CUSTOM && custom_profile == NULL) return; // no function to use
+  profile = _profile;
+}
+
+// Sets a custom ramp profile
+void VFDRamp::setProfile(VFD_RampProfile _profile) {
+  custom_profile = _profile;
+  profile = VFD_RAMP_CUSTOM;
+}
+
+// Sets how often the run frequency is read
+void VFDRamp::setLagCheck(uint8_t every) {
+  lag_every = every;
+}
+
+// Starts a ramp between two frequencies
+void VFDRamp::start(uint16_t from, uint16_t to, uint16_t ms) {
+  start_freq = from;
+  target_freq = to;
+  duration = ms;
+  started = VFD_MILLIS();
+  last_sent = started - interval; // first setpoint goes out on first update()
+  setpoint = from;
+  max_lag = 0;
+  lag = 0;
+  sent_count = 0;
+  active = true;
+}
+
+// Starts a ramp to a frequency
+void VFDRamp::start(uint16_t to, uint16_t ms) {
+  uint16_t from = sent_freq;
+  if(!has_setpoint) {
+    from = vfd->getAimFreqDeciHz();
+    if(vfd->lastCommErrorNum() != VFD_COMM_SUCCESS) from = to; // unknown, just go to target
+  }
+  start(from, to, ms);
+}
+
+// Stops the ramp
+void VFDRamp::stop() {
+  active = false;
+  setpoint = sent_freq;
+}
+
+// Runs the ramp
+bool VFDRamp::update() {
+  if(!active) return false;
+
+  uint32_t now = VFD_MILLIS();
+  uint32_t elapsed = now - started;
+  bool last = elapsed >= duration;
+
+  if(last) {
+    setpoint = target_freq;
+  }
+  else {
+    uint16_t progress = (uint16_t)(elapsed * VFD_RAMP_ONE / duration);
+    int32_t delta = (int32_t)target_freq - start_freq;
+    setpoint = start_freq + (int16_t)(delta * shape(progress) / VFD_RAMP_ONE);
+  }
+
+  // coalesce: intermediate setpoints computed between two sends are never sent
+  if(now - last_sent < interval) return true;
+  if(has_setpoint && setpoint == sent_freq) {
+    if(last) active = false;
+    return active;
+  }
+
+  last_sent = now;
+  if(vfd->setSpeedDeciHz(setpoint) != VFD_COMM_SUCCESS) return true; // retry next interval
+  sent_freq = setpoint;
+  has_setpoint = true;
+
+  if(lag_every != 0 && ++sent_count >= lag_every) {
+    sent_count = 0;
+    uint16_t run = vfd->getRunFreqDeciHz();
+    if(vfd->lastCommErrorNum() == VFD_COMM_SUCCESS) {
+      lag = (int16_t)(setpoint - run);
+      uint16_t abs_lag = lag < 0 ? -lag : lag;
+      if(abs_lag > max_lag) max_lag = abs_lag;
+    }
+  }
+
+  if(last) active = false;
+  return active;
+}
+
+// Gets if the ramp is in progress
+bool VFDRamp::isRamping() {
+  return active;
+}
+
+// Gets the last computed setpoint
+uint16_t VFDRamp::getSetpoint() {
+  return setpoint;
+}
+
+// Gets the lag at the last run frequency read
+int16_t VFDRamp::getLag() {
+  return lag;
+}
+
+// Gets the max lag in this ramp
+uint16_t VFDRamp::getMaxLag() {
+  return max_lag;
+}
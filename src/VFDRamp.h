@@ -0,0 +1,173 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Frequency ramp generator for YL-620 drives (S-curve and custom profiles)
+    @file VFDRamp.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_RAMP_H_
+#define _VFD_RAMP_H_
+
+#include "YL620-Arduino.h"
+
+/// Fixed-point 1.0 of ramp progress and profile output
+#define VFD_RAMP_ONE 1024
+
+#ifndef VFD_RAMP_INTERVAL
+  /// Default time between two setpoints sent to the drive, in ms
+  #define VFD_RAMP_INTERVAL 50
+#endif
+
+/// List of ramp profiles
+enum VFD_Ramp_Profiles : uint8_t {
+  VFD_RAMP_LINEAR = 0,  ///< Constant acceleration change
+  VFD_RAMP_S_CURVE, ///< Smooth start and end (no step in acceleration)
+  VFD_RAMP_CUSTOM,  ///< User function, see VFD_RampProfile
+};
+
+/**
+ * Custom ramp profile: gets the progress of the ramp in time (0 - VFD_RAMP_ONE)
+ * and returns the fraction of the frequency change to apply (0 - VFD_RAMP_ONE).
+ */
+typedef uint16_t (*VFD_RampProfile)(uint16_t progress);
+
+
+/**
+ * Generates frequency setpoints of a ramp and sends them to the drive.
+ * Setpoints are sent at most every update interval and only if changed,
+ * so the bus isn't flooded however often update() is called.
+ * @brief Frequency ramp generator
+ */
+class VFDRamp {
+  /// Drive the ramp is sent to
+  VFD* vfd;
+
+  uint16_t start_freq;  ///< Frequency at ramp start (0.1Hz)
+  uint16_t target_freq; ///< Frequency at ramp end (0.1Hz)
+  uint16_t duration;  ///< Ramp duration in ms
+  uint32_t started; ///< millis() at ramp start
+
+  uint16_t interval;  ///< Min time between two setpoints sent, in ms
+  uint32_t last_sent; ///< millis() of last setpoint sent
+  uint16_t setpoint;  ///< Last setpoint computed (0.1Hz)
+  uint16_t sent_freq; ///< Last setpoint the drive accepted (0.1Hz)
+
+  VFD_Ramp_Profiles profile;  ///< Profile of the ramp
+  VFD_RampProfile custom_profile; ///< Function for VFD_RAMP_CUSTOM profile
+
+  uint8_t lag_every;  ///< Read run frequency every lag_every setpoints (0 = never)
+  uint8_t sent_count; ///< Setpoints sent since last run frequency read
+  int16_t lag;  ///< Last setpoint - run frequency (0.1Hz)
+  uint16_t max_lag; ///< Max absolute lag in this ramp (0.1Hz)
+
+  bool has_setpoint;  ///< A setpoint was sent at least once
+  bool active;  ///< Ramp in progress
+
+  /**
+     * @brief Gets the profile fraction at a progress
+     * @param progress time progress of the ramp (0 - VFD_RAMP_ONE)
+     * @return fraction of the frequency change (0 - VFD_RAMP_ONE)
+  */
+  uint16_t shape(uint16_t progress);
+
+public:
+  /**
+     * @brief Constructor.
+     * @param _vfd drive to send the ramp to
+  */
+  VFDRamp(VFD& _vfd);
+
+  /**
+     * @brief Sets the min time between two setpoints sent to the drive
+     * @param ms time in ms (default VFD_RAMP_INTERVAL)
+  */
+  void setUpdateInterval(uint16_t ms);
+
+  /**
+     * @brief Sets the ramp profile
+     * @param _profile VFD_RAMP_LINEAR or VFD_RAMP_S_CURVE
+  */
+  void setProfile(VFD_Ramp_Profiles _profile);
+
+  /**
+     * @brief Sets a custom ramp profile
+     * @param _profile function mapping time progress to frequency fraction
+  */
+  void setProfile(VFD_RampProfile _profile);
+
+  /**
+     * Reading run frequency costs a transaction, so it's read only every few setpoints.
+     * @brief Sets how often the run frequency is read to monitor lag
+     * @param every read after every this many setpoints (0 disables)
+  */
+  void setLagCheck(uint8_t every);
+
+  /**
+     * @brief Starts a ramp between two frequencies
+     * @param from start frequency in 0.1Hz
+     * @param to end frequency in 0.1Hz
+     * @param ms duration of the ramp in ms
+  */
+  void start(uint16_t from, uint16_t to, uint16_t ms);
+
+  /**
+     * Starts from the last setpoint sent, or from the drive aim frequency if none was sent yet.
+     * @brief Starts a ramp to a frequency
+     * @param to end frequency in 0.1Hz
+     * @param ms duration of the ramp in ms
+  */
+  void start(uint16_t to, uint16_t ms);
+
+  /**
+     * @brief Stops the ramp at the last setpoint sent
+  */
+  void stop();
+
+  /**
+     * Call it often (es. every loop()). Computes the setpoint and sends it if the update interval
+     * elapsed and it changed. The last setpoint is always sent, retrying until the drive accepts it.
+     * @brief Runs the ramp
+     * @return true if the ramp is still in progress
+  */
+  bool update();
+
+  /**
+     * @brief Gets if the ramp is in progress
+     * @return true if in progress
+  */
+  bool isRamping();
+
+  /**
+     * @brief Gets the last computed setpoint
+     * @return setpoint in 0.1Hz
+  */
+  uint16_t getSetpoint();
+
+  /**
+     * @brief Gets the lag of the drive at the last run frequency read
+     * @return setpoint - run frequency in 0.1Hz
+  */
+  int16_t getLag();
+
+  /**
+     * @brief Gets the max lag of the drive in this ramp
+     * @return max absolute lag in 0.1Hz
+  */
+  uint16_t getMaxLag();
+};
+
+#endif  // _VFD_RAMP_H_
@@ -0,0 +1,94 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Bus scan for YL-620 drives
+    @file VFDScanner.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDScanner.h"
+
+// YL-620 baud table, indexed by the value of param P03.00
+static const uint32_t vfd_bauds[VFD_NUM_BAUDS] = {1200, 2400, 4800, 9600, 19200, 38400};
+
+
+// class constructor(s)
+VFDScanner::VFDScanner(Stream& _comm_stream) {
+  comm_stream = &_comm_stream;
+  first_address = 1;
+  last_address = 247;
+}
+VFDScanner::VFDScanner(Stream& _comm_stream, uint8_t _comm_pin) : transceiver(_comm_pin) {
+  comm_stream = &_comm_stream;
+  first_address = 1;
+  last_address = 247;
+}
+
+// Class init routine
+void VFDScanner::begin() {
+  transceiver.begin();
+}
+
+// Sets how the half-duplex transceiver is switched
+void VFDScanner::setDirectionMode(VFD_Direction_Modes mode) {
+  transceiver.setMode(mode);
+}
+
+// Limits the addresses to probe
+void VFDScanner::setAddressRange(uint8_t first, uint8_t last) {
+  first_address = first;
+  last_address = last;
+}
+
+// Finds the drives answering at a single baud
+uint8_t VFDScanner::scan(uint32_t baud, VFD_Discovered found[], uint8_t max_found) {
+  uint8_t num_found = 0;
+  VFD_Line line(*comm_stream, baud);
+  line.transceiver = transceiver; // switched as set up by begin()
+
+  for(uint16_t address = first_address; address <= last_address && num_found < max_found; address++) {
+    // the VFD object only holds the drive state, so a temporary one per address is cheap
+    VFD drive(address, line);
+
+    uint16_t id;
+    if(!drive.probe(&id)) continue;
+
+    found[num_found].address = address;
+    found[num_found].baud = baud;
+    found[num_found].cpu_id = id;
+    num_found++;
+  }
+  return num_found;
+}
+
+// Finds the drives and the baud of the line
+uint8_t VFDScanner::scanAllBauds(VFD_BaudSetter set_baud, VFD_Discovered found[], uint8_t max_found) {
+  // fastest first, a slow baud takes more time per address
+  for(int8_t i = VFD_NUM_BAUDS-1; i >= 0; i--) {
+    set_baud(vfd_bauds[i]);
+    while(comm_stream->available()) comm_stream->read(); // garbage received while changing baud
+
+    uint8_t num_found = scan(vfd_bauds[i], found, max_found);
+    if(num_found > 0) return num_found;
+  }
+  return 0;
+}
+
+// Gets the baud of a value of parameter P03.00
+uint32_t VFDScanner::baudFromParam(uint8_t param) {
+  if(param >= VFD_NUM_BAUDS) return 0;
+  return vfd_bauds[param];
+}
@@ -0,0 +1,122 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Bus scan for YL-620 drives: finds address (P03.01) and baud (P03.00) of the drives on a line
+    @file VFDScanner.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_SCANNER_H_
+#define _VFD_SCANNER_H_
+
+#include "YL620-Arduino.h"
+
+/// Number of entries of the YL-620 baud table (param P03.00)
+#define VFD_NUM_BAUDS 6
+
+/// Drive found on the bus
+struct VFD_Discovered {
+  uint8_t address;  ///< MODBUS address of the drive (param P03.01)
+  uint32_t baud;  ///< Baud the drive answered at (param P03.00)
+  uint16_t cpu_id;  ///< Unique id of the drive
+};
+
+/// Function changing the baud of the serial used for scanning (es. calls Serial2.begin(baud, SERIAL_8O1))
+typedef void (*VFD_BaudSetter)(uint32_t baud);
+
+
+/**
+ * @brief Finds the drives connected to a RS485 line
+ */
+class VFDScanner {
+  /// Stream class used for communication
+  Stream* comm_stream;
+
+  /// Transmit/receive switching of the half-duplex converter (no pin if not needed)
+  VFDDirection transceiver;
+
+  /// First address to probe
+  uint8_t first_address;
+
+  /// Last address to probe
+  uint8_t last_address;
+
+public:
+  /**
+     * @brief Constructor, for full-duplex adapters
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+  */
+  VFDScanner(Stream& _comm_stream);
+
+  /**
+     * @brief Constructor.
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+     * @param _comm_pin Arduino pin for commutating trasmit/receive mode.
+  */
+  VFDScanner(Stream& _comm_stream, uint8_t _comm_pin);
+
+  /**
+     * @brief First call for pin settings
+  */
+  void begin();
+
+  /**
+     * @brief Sets how the half-duplex transceiver is switched
+     * @param mode direction mode
+     * @see VFD::setDirectionMode()
+  */
+  void setDirectionMode(VFD_Direction_Modes mode);
+
+  /**
+     * @brief Limits the addresses to probe (default 1 - 247)
+     * @param first first address to probe
+     * @param last last address to probe
+  */
+  void setAddressRange(uint8_t first, uint8_t last);
+
+  /**
+     * Stream must already be set at baud. Each address takes the 3.5 chars of silence, the
+     * request and the short probe timeout (see VFD::probe()): ~25ms at 9600 baud, so the full
+     * range takes ~6s.
+     * @brief Finds the drives answering at a single baud
+     * @param baud baud the stream is set at
+     * @param found array that will contain the drives found
+     * @param max_found size of found array
+     * @return number of drives found
+  */
+  uint8_t scan(uint32_t baud, VFD_Discovered found[], uint8_t max_found);
+
+  /**
+     * Tries every baud of the YL-620 table, fastest first. All the drives of a line share the
+     * same baud, so the scan stops at the first baud with drives answering. The full range on a
+     * line with no drive answering takes ~90s, most of it at the slowest bauds.
+     * @brief Finds the drives and the baud of the line
+     * @param set_baud function that changes the baud of the stream
+     * @param found array that will contain the drives found
+     * @param max_found size of found array
+     * @return number of drives found
+  */
+  uint8_t scanAllBauds(VFD_BaudSetter set_baud, VFD_Discovered found[], uint8_t max_found);
+
+  /**
+     * @brief Gets the baud of a value of parameter P03.00
+     * @param param value of P03.00
+     * @return baud, 0 if param is out of the table
+  */
+  static uint32_t baudFromParam(uint8_t param);
+};
+
+#endif  // _VFD_SCANNER_H_
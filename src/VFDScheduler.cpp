@@ -0,0 +1,141 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Per-drive poll scheduling of the drives of a RS485 line
+    @file VFDScheduler.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDScheduler.h"
+
+
+// Private methods
+
+// Picks the drive to update: highest priority, then the most late
+int8_t VFDScheduler::pickDue() {
+  int8_t best = -1;
+  uint32_t best_late = 0;
+  uint32_t now = VFD_MILLIS();
+  for(uint8_t i = 0; i < num_drives; i++) {
+    uint32_t elapsed = now - drives[i].last_start;
+    uint16_t interval = getRequestedInterval(i);
+    if(drives[i].updated && elapsed < interval) continue;
+
+    // a drive never updated is due at once, late since it was added
+    uint32_t late = drives[i].updated ? elapsed - interval : elapsed;
+    if(best == -1 || drives[i].priority > drives[best].priority
+        || (drives[i].priority == drives[best].priority && late > best_late)) {
+      best = i;
+      best_late = late;
+    }
+  }
+  return best;
+}
+
+
+// Public methods
+
+// class constructor
+VFDScheduler::VFDScheduler(VFDBus& _bus) {
+  bus = &_bus;
+  num_drives = 0;
+  current = -1;
+  bus_share = 100;
+  next_allowed = 0;
+}
+
+// Adds a drive to poll
+int8_t VFDScheduler::addDrive(VFD& drive, uint8_t priority) {
+  if(num_drives >= VFD_SCHED_MAX_DRIVES) return -1;
+  VFD_ScheduledDrive& d = drives[num_drives];
+  d.drive = &drive;
+  d.health = NULL;
+  d.active_interval = VFD_SCHED_ACTIVE_INTERVAL;
+  d.idle_interval = VFD_SCHED_IDLE_INTERVAL;
+  d.priority = priority;
+  d.last_start = VFD_MILLIS();
+  d.updated = false;
+  d.achieved = 0;
+  return num_drives++;
+}
+
+// Sets how often a drive is updated
+void VFDScheduler::setIntervals(uint8_t slot, uint16_t active_ms, uint16_t idle_ms) {
+  drives[slot].active_interval = active_ms;
+  drives[slot].idle_interval = idle_ms;
+}
+
+// Feeds a health monitor with the updates of a drive
+void VFDScheduler::setHealth(uint8_t slot, VFDHealth& health) {
+  drives[slot].health = &health;
+}
+
+// Sets the max share of the line time used by updates
+void VFDScheduler::setBusShare(uint8_t percent) {
+  bus_share = percent < 1 ? 1 : percent > 100 ? 100 : percent;
+}
+
+// Queues the next update when due
+void VFDScheduler::poll() {
+  if(current != -1) {
+    VFD_ScheduledDrive& d = drives[current];
+    if(!VFDBus::done(d.t)) return; // one update at a time
+    if(d.health != NULL) d.health->check(d.t.error);
+    current = -1;
+  }
+
+  if((int32_t)(VFD_MICROS() - next_allowed) < 0) return; // keep within the line share
+  int8_t i = pickDue();
+  if(i == -1) return;
+
+  VFD_ScheduledDrive& d = drives[i];
+  if(!bus->update(d.t, *d.drive)) return;
+  uint32_t now = VFD_MILLIS();
+  if(d.updated) { // the first update has no period before it
+    uint32_t period = now - d.last_start;
+    if(d.achieved == 0) d.achieved = period > 0xFFFF ? 0xFFFF : period;
+    else d.achieved = ((uint32_t)d.achieved*7 + (period > 0xFFFF ? 0xFFFF : period)) / 8;
+  }
+  d.last_start = now;
+  d.updated = true;
+  current = i;
+
+  // the update takes readCost() of line time, which is bus_share percent of the time until the next one
+  next_allowed = VFD_MICROS() + bus->readCost(VFD_POLL_SPAN) * 100 / bus_share;
+}
+
+// Time between updates a drive should get now
+uint16_t VFDScheduler::getRequestedInterval(uint8_t slot) {
+  VFD_ScheduledDrive& d = drives[slot];
+  uint16_t interval = d.drive->fetchRunning() ? d.active_interval : d.idle_interval;
+  if(d.health != NULL && d.health->getPollInterval() < interval) interval = d.health->getPollInterval();
+  return interval;
+}
+
+// Time between updates a drive is getting
+uint16_t VFDScheduler::getAchievedInterval(uint8_t slot) {
+  return drives[slot].achieved;
+}
+
+// Max updates per second of the line, at the set share
+uint16_t VFDScheduler::getMaxRate() {
+  return 1000000UL * bus_share / 100 / bus->readCost(VFD_POLL_SPAN);
+}
+
+// Last update transaction of a drive
+const VFD_Transaction& VFDScheduler::getTransaction(uint8_t slot) {
+  return drives[slot].t;
+}
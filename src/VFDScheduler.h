@@ -0,0 +1,162 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Per-drive poll scheduling of the drives of a RS485 line
+    @file VFDScheduler.h
+    @author Lorenzo Carloni
+*/
+
+#ifndef _VFD_SCHEDULER_H_
+#define _VFD_SCHEDULER_H_
+
+#include "VFDBus.h"
+#include "VFDHealth.h"
+
+#ifndef VFD_SCHED_MAX_DRIVES
+  /// Max number of drives polled by a scheduler
+  #define VFD_SCHED_MAX_DRIVES 8
+#endif
+
+#ifndef VFD_SCHED_ACTIVE_INTERVAL
+  /// Default time between updates of a running drive, in ms
+  #define VFD_SCHED_ACTIVE_INTERVAL 100
+#endif
+
+#ifndef VFD_SCHED_IDLE_INTERVAL
+  /// Default time between updates of a stopped drive, in ms
+  #define VFD_SCHED_IDLE_INTERVAL 1000
+#endif
+
+/// Polling state of a drive, see VFDScheduler
+struct VFD_ScheduledDrive {
+  VFD* drive; ///< Drive polled
+  VFDHealth* health;  ///< Health monitor fed by the updates (NULL if none)
+  VFD_Transaction t;  ///< Update transaction
+  uint16_t active_interval; ///< Time between updates while running or ramping, in ms
+  uint16_t idle_interval; ///< Time between updates while stopped, in ms
+  uint8_t priority; ///< Higher goes first when more drives are due
+  uint32_t last_start;  ///< millis() of the last update queued, or of addDrive() before the first
+  bool updated; ///< An update was queued, last_start is its time
+  uint16_t achieved;  ///< Average time between updates, in ms (0 no data yet)
+};
+
+
+/**
+ * Updates the drives of a line through VFDBus, each at its own rate: running drives fast,
+ * stopped drives slow, faster when a VFDHealth monitor finds something wrong.
+ * One update at a time is queued, when more are due the highest priority goes first, then the
+ * most late one. The line time used is capped to a share of what the baud allows,
+ * so the requests of the sketch still find room.
+ * @brief Adaptive poll scheduler of a line
+ */
+class VFDScheduler {
+  /// Line the drives are on
+  VFDBus* bus;
+
+  /// Drives polled
+  VFD_ScheduledDrive drives[VFD_SCHED_MAX_DRIVES];
+
+  /// Number of drives polled
+  uint8_t num_drives;
+
+  /// Drive with an update on the line (-1 none)
+  int8_t current;
+
+  /// Percent of the line time updates can use
+  uint8_t bus_share;
+
+  /// micros() before which no update is queued, to keep within the line share
+  uint32_t next_allowed;
+
+  /**
+     * @brief Picks the drive to update
+     * @return position in drives, -1 if none is due
+  */
+  int8_t pickDue();
+
+public:
+  /**
+     * @brief Constructor
+     * @param _bus line the drives are on
+  */
+  VFDScheduler(VFDBus& _bus);
+
+  /**
+     * @brief Adds a drive to poll, with default intervals
+     * @param drive drive to poll
+     * @param priority higher goes first when more drives are due
+     * @return position of the drive (used by the other methods), -1 if VFD_SCHED_MAX_DRIVES are already polled
+  */
+  int8_t addDrive(VFD& drive, uint8_t priority);
+
+  /**
+     * @brief Sets how often a drive is updated
+     * @param slot position of the drive, see addDrive()
+     * @param active_ms time between updates while running or ramping
+     * @param idle_ms time between updates while stopped
+  */
+  void setIntervals(uint8_t slot, uint16_t active_ms, uint16_t idle_ms);
+
+  /**
+     * The monitor is checked after each update of the drive, and its suggested interval
+     * is used when shorter.
+     * @brief Feeds a health monitor with the updates of a drive
+     * @param slot position of the drive, see addDrive()
+     * @param health health monitor of the drive
+  */
+  void setHealth(uint8_t slot, VFDHealth& health);
+
+  /**
+     * @brief Sets the max share of the line time used by updates (default 100)
+     * @param percent share of line time, 1 - 100
+  */
+  void setBusShare(uint8_t percent);
+
+  /**
+     * Call from loop(), together with VFDBus::poll().
+     * @brief Queues the next update when due
+  */
+  void poll();
+
+  /**
+     * @brief Time between updates a drive should get now
+     * @param slot position of the drive, see addDrive()
+     * @return interval in ms
+  */
+  uint16_t getRequestedInterval(uint8_t slot);
+
+  /**
+     * @brief Time between updates a drive is getting
+     * @param slot position of the drive, see addDrive()
+     * @return average interval in ms, 0 before the second update
+  */
+  uint16_t getAchievedInterval(uint8_t slot);
+
+  /**
+     * @brief Max updates per second of the line, at the set share
+     * @return updates per second
+  */
+  uint16_t getMaxRate();
+
+  /**
+     * @brief Last update transaction of a drive (check error of the last update)
+     * @param slot position of the drive, see addDrive()
+     * @return update transaction
+  */
+  const VFD_Transaction& getTransaction(uint8_t slot);
+};
+
+#endif  // _VFD_SCHEDULER_H_
@@ -0,0 +1,421 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Simulated RS485 line with simulated YL-620 drives, for load tests without hardware
+    @file VFDSim.cpp
+    @author Lorenzo Carloni
+*/
+
+#include "VFDSim.h"
+
+/// Position of a register in VFD_SimDrive::regs
+#define VFD_SIM_REG(r) ((r) - VFD_SIM_FIRST_REGISTER)
+
+
+#ifdef VFD_VIRTUAL_TIME
+// Virtual clock of the library, 64 bits so VFD_MILLIS() wraps as millis() does
+static uint64_t virtual_us = 0;
+
+// Clock of the library, in microseconds
+uint32_t VFD_virtualMicros() {
+  virtual_us += VFD_SIM_TICK_US;  // busy waits must end: time passes while the library looks at it
+  return (uint32_t)virtual_us;
+}
+
+// Clock of the library, in milliseconds
+uint32_t VFD_virtualMillis() {
+  virtual_us += VFD_SIM_TICK_US;
+  return (uint32_t)(virtual_us / 1000);
+}
+
+// Blocking wait of the library
+void VFD_virtualDelay(uint32_t ms) {
+  virtual_us += (uint64_t)ms * 1000;
+}
+#endif
+
+
+// Private methods
+
+// Current time of the line
+uint32_t VFDSimLine::now() {
+#ifdef VFD_VIRTUAL_TIME
+  return (uint32_t)virtual_us;
+#else
+  return micros();
+#endif
+}
+
+// Waits until a time
+void VFDSimLine::waitUntil(uint32_t us) {
+#ifdef VFD_VIRTUAL_TIME
+  int32_t left = (int32_t)(us - (uint32_t)virtual_us);
+  if(left > 0) virtual_us += left;
+#else
+  while((int32_t)(micros() - us) < 0);
+#endif
+}
+
+// Next random number (xorshift32)
+uint32_t VFDSimLine::nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+// Number of answer bytes received by now
+uint8_t VFDSimLine::arrived() {
+  if(response_len == 0) return 0;
+  uint32_t at = now();
+  if((int32_t)(at - response_us) < 0) return 0;
+  uint32_t n = (at - response_us) / char_us + 1;
+  return n > response_len ? response_len : n;
+}
+
+// Finds a drive by address
+VFD_SimDrive* VFDSimLine::findDrive(uint8_t address) {
+  for(uint8_t i = 0; i < num_drives; i++) {
+    if(drives[i].address == address) return &drives[i];
+  }
+  return NULL;
+}
+
+// Moves the run frequency of a drive towards its target
+void VFDSimLine::ramp(VFD_SimDrive& d, uint32_t at) {
+  uint16_t* regs = d.regs;
+  uint16_t aim = (regs[VFD_SIM_REG(VFD_REGISTER_COMMAND)] & VFD_COMMAND_START) ? regs[VFD_SIM_REG(VFD_REGISTER_FREQUENCY)] : 0;
+  uint16_t run = regs[VFD_SIM_REG(VFD_REGISTER_RUN_FREQ)];
+  uint16_t ramp_time = run < aim ? regs[VFD_SIM_REG(VFD_REGISTER_ACCEL_TIME)] : regs[VFD_SIM_REG(VFD_REGISTER_DECEL_TIME)];
+
+  if(run == aim || ramp_time == 0) {
+    run = aim;
+    d.ramped_us = at;
+  }
+  else {
+    // ramp time (0.1s) is for 50Hz: one 0.1Hz step every ramp_time*200 microseconds
+    uint32_t step_us = (uint32_t)ramp_time * 200;
+    uint32_t steps = (at - d.ramped_us) / step_us;
+    uint16_t distance = run < aim ? aim - run : run - aim;
+    if(steps > distance) steps = distance;
+    d.ramped_us += steps * step_us;
+    run = run < aim ? run + steps : run - steps;
+  }
+
+  regs[VFD_SIM_REG(VFD_REGISTER_AIM_FREQ)] = aim;
+  regs[VFD_SIM_REG(VFD_REGISTER_RUN_FREQ)] = run;
+  regs[VFD_SIM_REG(VFD_REGISTER_ACC_DEC_FLAG)] = run < aim ? 1 : run > aim ? 2 : 0;
+  regs[VFD_SIM_REG(VFD_REGISTER_OUT_CURR)] = run == 0 ? 0 : 2 + run / 50;
+  regs[VFD_SIM_REG(VFD_REGISTER_RUN_VOLT)] = (uint32_t)run * 380 / 500;
+  regs[VFD_SIM_REG(VFD_REGISTER_CURRENT_ACCEL_TIME)] = regs[VFD_SIM_REG(VFD_REGISTER_ACCEL_TIME)];
+  regs[VFD_SIM_REG(VFD_REGISTER_CURRENT_DECEL_TIME)] = regs[VFD_SIM_REG(VFD_REGISTER_DECEL_TIME)];
+}
+
+// Reads a register of a drive
+bool VFDSimLine::readRegister(VFD_SimDrive& d, uint16_t r, uint16_t* value) {
+  if(r == VFD_REGISTER_UNIQUE_ID) {
+    *value = d.cpu_id;
+    return true;
+  }
+  if(r < VFD_SIM_FIRST_REGISTER || r >= VFD_SIM_FIRST_REGISTER + VFD_SIM_REGISTERS) return false;
+  *value = d.regs[VFD_SIM_REG(r)];
+  return true;
+}
+
+// Checks if a register can be written
+bool VFDSimLine::writable(uint16_t r) {
+  uint8_t i = VFD_registerIndex(r);
+  return i < VFD_REGISTER_MAP_SIZE && (VFD_REGISTER_MAP[i].access & VFD_ACCESS_WRITE);
+}
+
+// Writes a register of a drive
+bool VFDSimLine::writeRegister(VFD_SimDrive& d, uint16_t r, uint16_t value) {
+  if(r == VFD_REGISTER_COMMAND) {
+    // the register reads back the last start/stop and the direction
+    uint16_t command = d.regs[VFD_SIM_REG(VFD_REGISTER_COMMAND)];
+    if(value & VFD_COMMAND_STOP) command = (command & ~VFD_COMMAND_START) | VFD_COMMAND_STOP;
+    else if(value & VFD_COMMAND_START) command = (command & ~VFD_COMMAND_STOP) | VFD_COMMAND_START;
+    uint16_t direction = value & VFD_COMMAND_CHANGE_DIRECTION;
+    if(direction == VFD_COMMAND_FORWARD) command |= VFD_COMMAND_FORWARD;
+    else if(direction == VFD_COMMAND_BACKWARD) command &= ~VFD_COMMAND_FORWARD;
+    else if(direction == VFD_COMMAND_CHANGE_DIRECTION) command ^= VFD_COMMAND_FORWARD;
+    d.regs[VFD_SIM_REG(VFD_REGISTER_COMMAND)] = command;
+    return true;
+  }
+  if(!writable(r)) return false;
+  d.regs[VFD_SIM_REG(r)] = value;
+  return true;
+}
+
+// Length of the request being received
+uint8_t VFDSimLine::requestLength() {
+  if(request_len < 2) return 0;
+  if(request[1] != 0x10) return 8;
+  if(request_len < 7) return 0; // byte count not received yet
+  uint16_t len = 9 + request[6];
+  return len > VFD_SIM_MAX_FRAME ? VFD_SIM_MAX_FRAME : len; // a bogus frame still ends, and fails the CRC
+}
+
+// Builds the answer of a drive to the request
+uint8_t VFDSimLine::buildResponse(VFD_SimDrive& d) {
+  uint8_t function = request[1];
+  uint16_t start = (request[2] << 8) | request[3];
+  uint16_t count = (request[4] << 8) | request[5];
+  uint8_t exception = 0;
+  response[0] = d.address;
+
+  if(function == 0x03) {
+    if(count == 0 || count > VFD_MAX_RANGE_REGISTERS) exception = 0x03;
+    for(uint8_t i = 0; i < count && exception == 0; i++) {
+      uint16_t value;
+      if(!readRegister(d, start+i, &value)) exception = 0x02;
+      response[3+2*i] = (uint8_t)(value >> 8);
+      response[4+2*i] = (uint8_t)value;
+    }
+    if(exception == 0) {
+      response[1] = 0x03;
+      response[2] = 2*count;
+      return 3 + 2*count;
+    }
+  }
+  else if(function == 0x06) {
+    if(writeRegister(d, start, count)) {
+      for(uint8_t i = 1; i < 6; i++) response[i] = request[i];  // echo
+      return 6;
+    }
+    exception = 0x02;
+  }
+  else if(function == 0x10) {
+    if(count == 0 || count > VFD_MAX_RANGE_REGISTERS || request[6] != 2*count) exception = 0x03;
+    for(uint8_t i = 0; i < count && exception == 0; i++) { // all or nothing
+      if(!writable(start+i)) exception = 0x02;
+    }
+    if(exception == 0) {
+      for(uint8_t i = 0; i < count; i++) writeRegister(d, start+i, (request[7+2*i] << 8) | request[8+2*i]);
+      for(uint8_t i = 1; i < 6; i++) response[i] = request[i];
+      return 6;
+    }
+  }
+  else {
+    exception = 0x01;
+  }
+
+  response[1] = function | 0x80;
+  response[2] = exception;
+  return 3;
+}
+
+// Serves a complete request
+void VFDSimLine::serveRequest(uint32_t end_us) {
+  uint8_t len = request_len;
+  request_len = 0;
+  requests++;
+
+  uint16_t crc = VFD::calcCrc(request, len-2);
+  if(request_garbled || request[len-2] != (uint8_t)(crc >> 8) || request[len-1] != (uint8_t)crc) {
+    bad_requests++;
+    return;
+  }
+
+  if(request[0] == 0) { // broadcast: every drive applies it, none answers
+    response_len = response_pos = 0;
+    for(uint8_t i = 0; i < num_drives; i++) {
+      if(!drives[i].online) continue;
+      ramp(drives[i], end_us);
+      if(request[1] != 0x03) buildResponse(drives[i]);
+    }
+    return;
+  }
+
+  VFD_SimDrive* d = findDrive(request[0]);
+  if(d == NULL || !d->online) return;
+  d->requests++;
+  ramp(*d, end_us);
+  uint8_t n = buildResponse(*d);
+
+  crc = VFD::calcCrc(response, n);
+  response[n] = (uint8_t)(crc >> 8);
+  response[n+1] = (uint8_t)crc;
+  n += 2;
+
+  // the drive got the request (a write is applied), its answer may not make it back
+  if(nextRandom() % 1000 < drop_permille) {
+    dropped++;
+    return;
+  }
+  if(nextRandom() % 1000 < corrupt_permille) {
+    response[nextRandom() % n] ^= 1 << (nextRandom() % 8);
+    corrupted++;
+  }
+
+  response_len = n;
+  response_pos = 0;
+  response_us = end_us + d->turnaround_us + char_us;
+  busy_us += (uint32_t)n * char_us;
+  d->answers++;
+  answers++;
+}
+
+
+// Public methods
+
+// class constructor(s)
+VFDSimLine::VFDSimLine(uint32_t baud, VFD_SimDrive _drives[], uint8_t _num_drives) {
+  drives = _drives;
+  num_drives = _num_drives;
+  char_us = 11000000UL / baud;
+  for(uint8_t i = 0; i < num_drives; i++) {
+    VFD_SimDrive& d = drives[i];
+    d.address = i + 1;
+    d.online = true;
+    d.turnaround_us = VFD_SIM_TURNAROUND_US;
+    d.cpu_id = 0x5900 + i + 1;
+    memset(d.regs, 0, sizeof(d.regs));
+    d.regs[VFD_SIM_REG(VFD_REGISTER_COMMAND)] = VFD_COMMAND_STOP | VFD_COMMAND_FORWARD;
+    d.regs[VFD_SIM_REG(VFD_REGISTER_ACCEL_TIME)] = 50;
+    d.regs[VFD_SIM_REG(VFD_REGISTER_DECEL_TIME)] = 50;
+    d.regs[VFD_SIM_REG(VFD_REGISTER_BUS_VOLT)] = 311;
+    d.ramped_us = now();
+    d.requests = d.answers = 0;
+  }
+
+  request_len = 0;
+  request_garbled = false;
+  tx_end_us = now();
+  response_len = response_pos = 0;
+  response_us = 0;
+  corrupt_permille = drop_permille = 0;
+  seed = 1;
+  resetStats();
+}
+
+// Sets the faults injected on the answers
+void VFDSimLine::setFaults(uint8_t _corrupt_permille, uint8_t _drop_permille) {
+  corrupt_permille = _corrupt_permille;
+  drop_permille = _drop_permille;
+}
+
+// Restarts the random generator
+void VFDSimLine::setSeed(uint32_t _seed) {
+  seed = _seed != 0 ? _seed : 1; // xorshift never leaves 0
+}
+
+// Restarts the statistics of the line
+void VFDSimLine::resetStats() {
+  started_us = now();
+  busy_us = 0;
+  requests = answers = 0;
+  corrupted = dropped = 0;
+  collisions = bad_requests = 0;
+}
+
+// Complete requests seen
+uint32_t VFDSimLine::requestCount() {
+  return requests;
+}
+
+// Answers sent
+uint32_t VFDSimLine::answerCount() {
+  return answers;
+}
+
+// Answers corrupted on purpose
+uint32_t VFDSimLine::corruptedCount() {
+  return corrupted;
+}
+
+// Answers dropped on purpose
+uint32_t VFDSimLine::droppedCount() {
+  return dropped;
+}
+
+// Requests sent while a drive was answering
+uint32_t VFDSimLine::collisionCount() {
+  return collisions;
+}
+
+// Requests the drives couldn't decode
+uint32_t VFDSimLine::badRequestCount() {
+  return bad_requests;
+}
+
+// Time the line carried bytes
+uint32_t VFDSimLine::getBusyTime() {
+  return busy_us;
+}
+
+// Share of time the line carried bytes
+uint8_t VFDSimLine::getUtilization() {
+  uint32_t elapsed = now() - started_us;
+  if(elapsed == 0) return 0;
+  uint32_t percent = busy_us / (elapsed / 100 + 1);
+  return percent > 100 ? 100 : percent;
+}
+
+int VFDSimLine::available() {
+  uint8_t n = arrived() - response_pos;
+#ifdef VFD_VIRTUAL_TIME
+  if(n == 0 && response_pos < response_len) {
+    // nothing else can happen meanwhile: skip towards the next byte, a char at most so timeouts still hold
+    uint32_t next_us = response_us + (uint32_t)response_pos*char_us;
+    int32_t left = (int32_t)(next_us - now());
+    waitUntil(now() + (left > (int32_t)char_us ? char_us : left));
+    n = arrived() - response_pos;
+  }
+#endif
+  return n;
+}
+
+int VFDSimLine::read() {
+  if(available() <= 0) return -1;
+  return response[response_pos++];
+}
+
+int VFDSimLine::peek() {
+  if(available() <= 0) return -1;
+  return response[response_pos];
+}
+
+// Puts a byte of a request on the line, at its end the addressed drive answers
+size_t VFDSimLine::write(uint8_t b) {
+  uint32_t at = now();
+  if(request_len > 0 && (int32_t)(at - tx_end_us) > (int32_t)(35UL*char_us/10)) {
+    bad_requests++; // 3.5 chars of silence end a frame: what came before was incomplete
+    request_len = 0;
+  }
+  if(request_len == 0) request_garbled = false;
+
+  // a drive still answering: both frames are garbled
+  if(response_len > 0 && (int32_t)(at - (response_us + (uint32_t)(response_len-1)*char_us)) < 0) {
+    if(request_len == 0) collisions++;
+    request_garbled = true;
+    for(uint8_t i = arrived(); i < response_len; i++) response[i] ^= 0x55;
+  }
+
+  uint32_t start = (int32_t)(at - tx_end_us) > 0 ? at : tx_end_us; // bytes queue up in the serial buffer
+  tx_end_us = start + char_us;
+  busy_us += char_us;
+  if(request_len < VFD_SIM_MAX_FRAME) request[request_len++] = b;
+
+  uint8_t len = requestLength();
+  if(len != 0 && request_len >= len) serveRequest(tx_end_us);
+  return 1;
+}
+
+// Waits until the last byte of the request is out
+void VFDSimLine::flush() {
+  waitUntil(tx_end_us);
+}
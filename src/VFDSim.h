@@ -0,0 +1,269 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Simulated RS485 line with simulated YL-620 drives, for load tests without hardware
+    @file VFDSim.h
+    @author Lorenzo Carloni
+
+    Used as the Stream of a VFD or VFDBus, in place of the serial port. Built with VFD_VIRTUAL_TIME
+    defined (es. -DVFD_VIRTUAL_TIME, for the whole library) it runs in virtual time: the library
+    clock jumps to the next byte on the line instead of waiting, and every reading of it moves it
+    on by VFD_SIM_TICK_US. Runs are deterministic (same seed, same sketch, same results) and much
+    faster than real time. Without it the line runs in real time, es. to try a sketch on a board
+    with no drive connected.
+*/
+
+#ifndef _VFD_SIM_H_
+#define _VFD_SIM_H_
+
+#include "YL620-Arduino.h"
+
+#ifndef VFD_SIM_TURNAROUND_US
+  /// Default time a simulated drive takes to start answering, in microseconds
+  #define VFD_SIM_TURNAROUND_US 1000
+#endif
+
+#ifndef VFD_SIM_TICK_US
+  /// Virtual time elapsed at every reading of the clock, in microseconds (VFD_VIRTUAL_TIME only)
+  #define VFD_SIM_TICK_US 1
+#endif
+
+/// First register of a simulated drive
+#define VFD_SIM_FIRST_REGISTER VFD_REGISTER_COMMAND
+/// Number of registers of a simulated drive, from VFD_SIM_FIRST_REGISTER to VFD_REGISTER_CURRENT_DECEL_TIME
+#define VFD_SIM_REGISTERS (VFD_REGISTER_CURRENT_DECEL_TIME - VFD_SIM_FIRST_REGISTER + 1)
+/// Size of the longest frame on the line (write multiple registers request)
+#define VFD_SIM_MAX_FRAME (9+2*VFD_MAX_RANGE_REGISTERS)
+
+/**
+ * Registers from VFD_REGISTER_COMMAND to VFD_REGISTER_CURRENT_DECEL_TIME and the unique id
+ * are simulated, anything else is answered with an exception. Once started the run frequency
+ * ramps to the set frequency in the accel/decel time (for 50Hz), current and voltage follow it.
+ * Can be changed by the sketch while the simulation runs (es. online = false for a dead drive).
+ * @brief A simulated YL-620 drive
+ */
+struct VFD_SimDrive {
+  uint8_t address;  ///< MODBUS address (param P03.01)
+  bool online;  ///< Answers requests
+  uint16_t turnaround_us; ///< Time it takes to start answering, in microseconds
+  uint16_t cpu_id;  ///< Unique id
+  uint16_t regs[VFD_SIM_REGISTERS]; ///< Registers from VFD_SIM_FIRST_REGISTER
+  uint32_t ramped_us; ///< Clock of the last ramp step
+  uint32_t requests;  ///< Requests addressed to it
+  uint32_t answers; ///< Answers sent
+};
+
+
+/**
+ * Models the byte time (11 bits per char), the 3.5 chars of silence between frames, the drive
+ * turnaround and collisions (a request sent while a drive is answering garbles both).
+ * Faults can be injected: random CRC corruption of answers and dropped answers.
+ * @brief RS485 line with simulated YL-620 drives
+ */
+class VFDSimLine : public Stream {
+  VFD_SimDrive* drives; ///< Drives on the line
+  uint8_t num_drives; ///< Number of drives
+  uint16_t char_us; ///< Time of a character on the line, in microseconds
+
+  uint8_t request[VFD_SIM_MAX_FRAME]; ///< Request being received by the drives
+  uint8_t request_len;  ///< Bytes of the request received so far
+  bool request_garbled; ///< A collision corrupted the request
+  uint32_t tx_end_us; ///< Clock at which the last byte sent to the drives is out
+
+  uint8_t response[VFD_SIM_MAX_FRAME];  ///< Answer of a drive
+  uint8_t response_len; ///< Length of the answer
+  uint8_t response_pos; ///< Bytes of the answer already read
+  uint32_t response_us; ///< Clock at which the first byte of the answer is received
+
+  uint8_t corrupt_permille; ///< Answers with a corrupted byte, per thousand
+  uint8_t drop_permille;  ///< Answers lost, per thousand
+  uint32_t seed;  ///< Random generator state
+
+  uint32_t started_us;  ///< Clock at the last resetStats()
+  uint32_t busy_us; ///< Time the line carried bytes since started_us
+  uint32_t requests;  ///< Complete requests seen
+  uint32_t answers; ///< Answers sent
+  uint32_t corrupted; ///< Answers corrupted on purpose
+  uint32_t dropped; ///< Answers dropped on purpose
+  uint32_t collisions;  ///< Requests sent while a drive was answering
+  uint32_t bad_requests;  ///< Requests the drives couldn't decode (CRC, garbled)
+
+  /**
+     * @brief Current time of the line, without moving the virtual clock on
+     * @return micros(), or virtual micros with VFD_VIRTUAL_TIME
+  */
+  static uint32_t now();
+
+  /**
+     * @brief Waits until a time: with VFD_VIRTUAL_TIME just moves the clock on
+     * @param us clock to wait for
+  */
+  static void waitUntil(uint32_t us);
+
+  /**
+     * @brief Next random number (xorshift, deterministic for a given seed)
+     * @return random number
+  */
+  uint32_t nextRandom();
+
+  /**
+     * @brief Number of answer bytes received by now
+     * @return bytes received, read or not
+  */
+  uint8_t arrived();
+
+  /**
+     * @brief Finds a drive by address
+     * @param address MODBUS address
+     * @return drive, NULL if not on the line
+  */
+  VFD_SimDrive* findDrive(uint8_t address);
+
+  /**
+     * @brief Moves the run frequency of a drive towards its target, for the time elapsed
+     * @param d drive
+     * @param at current clock
+  */
+  static void ramp(VFD_SimDrive& d, uint32_t at);
+
+  /**
+     * @brief Reads a register of a drive
+     * @param d drive
+     * @param r register
+     * @param value will contain the register value
+     * @return false if not simulated
+  */
+  static bool readRegister(VFD_SimDrive& d, uint16_t r, uint16_t* value);
+
+  /**
+     * @brief Checks if a register can be written, as VFD_REGISTER_MAP says
+     * @param r register
+     * @return true if writable
+  */
+  static bool writable(uint16_t r);
+
+  /**
+     * @brief Writes a register of a drive
+     * @param d drive
+     * @param r register
+     * @param value value to write
+     * @return false if not writable
+  */
+  static bool writeRegister(VFD_SimDrive& d, uint16_t r, uint16_t value);
+
+  /**
+     * @brief Length of the request being received, once its function is known
+     * @return full length of the request (CRC included), 0 if not known yet
+  */
+  uint8_t requestLength();
+
+  /**
+     * @brief Serves a complete request, queuing the answer of the drive
+     * @param end_us clock at which the last byte of the request is out
+  */
+  void serveRequest(uint32_t end_us);
+
+  /**
+     * @brief Builds the answer of a drive to the request
+     * @param d drive
+     * @return length of the answer without CRC, 0 if the drive doesn't answer
+  */
+  uint8_t buildResponse(VFD_SimDrive& d);
+
+public:
+  /**
+     * Drives get addresses 1 to _num_drives, VFD_SIM_TURNAROUND_US, stopped at 0Hz with 5s ramps.
+     * @brief Constructor
+     * @param baud baud of the line
+     * @param _drives drives on the line, set up by the constructor (can be changed afterwards)
+     * @param _num_drives number of drives
+  */
+  VFDSimLine(uint32_t baud, VFD_SimDrive _drives[], uint8_t _num_drives);
+
+  /**
+     * @brief Sets the faults injected on the answers (default none)
+     * @param _corrupt_permille answers with a corrupted byte, per thousand
+     * @param _drop_permille answers lost, per thousand
+  */
+  void setFaults(uint8_t _corrupt_permille, uint8_t _drop_permille);
+
+  /**
+     * @brief Restarts the random generator, runs with the same seed inject the same faults
+     * @param _seed seed (not 0)
+  */
+  void setSeed(uint32_t _seed);
+
+  /**
+     * @brief Restarts the statistics of the line
+  */
+  void resetStats();
+
+  /**
+     * @brief Complete requests seen since resetStats()
+     * @return number of requests
+  */
+  uint32_t requestCount();
+
+  /**
+     * @brief Answers sent since resetStats()
+     * @return number of answers
+  */
+  uint32_t answerCount();
+
+  /**
+     * @brief Answers corrupted on purpose since resetStats()
+     * @return number of answers
+  */
+  uint32_t corruptedCount();
+
+  /**
+     * @brief Answers dropped on purpose since resetStats()
+     * @return number of answers
+  */
+  uint32_t droppedCount();
+
+  /**
+     * @brief Requests sent while a drive was answering since resetStats()
+     * @return number of collisions
+  */
+  uint32_t collisionCount();
+
+  /**
+     * @brief Requests the drives couldn't decode since resetStats()
+     * @return number of requests
+  */
+  uint32_t badRequestCount();
+
+  /**
+     * @brief Time the line carried bytes since resetStats(), in microseconds
+     * @return busy time
+  */
+  uint32_t getBusyTime();
+
+  /**
+     * @brief Share of time the line carried bytes since resetStats()
+     * @return percent
+  */
+  uint8_t getUtilization();
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t b);
+  void flush();
+};
+
+#endif  // _VFD_SIM_H_
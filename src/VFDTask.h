@@ -0,0 +1,65 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+    Tasks waiting for VFDBus transactions without blocking or callbacks (stackless, as protothreads)
+    @file VFDTask.h
+    @author Lorenzo Carloni
+
+    A task is a function returning bool, called over and over from loop(): it runs until it has to
+    wait, then returns false and resumes from there at the next call. It returns true once finished,
+    and starts over at the following call.
+
+        VFD_Task seq;
+        bool sequence() {
+          VFD_TASK_BEGIN(seq);
+          VFD_TASK_RUN(seq, bus.write(t, spindle, VFD_REGISTER_FREQUENCY, 500), t);
+          VFD_TASK_WAIT_AT_SPEED(seq, bus, t, spindle);
+          VFD_TASK_RUN(seq, bus.write(t, pump, VFD_REGISTER_COMMAND, VFD_COMMAND_START), t);
+          VFD_TASK_END(seq);
+        }
+
+    Local variables don't survive a wait: keep state in globals or static variables.
+    A task can't use switch statements, and only one wait per line.
+*/
+
+#ifndef _VFD_TASK_H_
+#define _VFD_TASK_H_
+
+#include "VFDBus.h"
+
+/// Where a task stopped (0 at start)
+typedef uint16_t VFD_Task;
+
+/// Starts the body of a task, resuming where it stopped
+#define VFD_TASK_BEGIN(task) switch(task) { case 0:
+
+/// Ends the body of a task: returns true and starts over at the next call
+#define VFD_TASK_END(task) } (task) = 0; return true;
+
+/// Waits until cond is true
+#define VFD_TASK_AWAIT(task, cond) do { (task) = __LINE__; case __LINE__: if(!(cond)) return false; } while(0)
+
+/// Lets the rest of loop() run, resumes at the next call
+#define VFD_TASK_YIELD(task) do { (task) = __LINE__; return false; case __LINE__:; } while(0)
+
+/// Queues a transaction (queue is a VFDBus call, es. bus.update(t, drive)) and waits until it's done
+#define VFD_TASK_RUN(task, queue, t) do { queue; VFD_TASK_AWAIT(task, VFDBus::done(t)); } while(0)
+
+/// Updates drive until it runs at the frequency it's aiming to (or a transaction fails, see t.error)
+#define VFD_TASK_WAIT_AT_SPEED(task, bus, t, drive) \
+  do { VFD_TASK_RUN(task, (bus).update(t, drive), t); } while((t).error == VFD_COMM_SUCCESS && !(drive).fetchAtSpeed())
+
+#endif  // _VFD_TASK_H_
@@ -21,6 +21,14 @@
 */
 
 #include "YL620-Arduino.h"
+#include "VFDCapture.h"
+#include "VFDBus.h"
+
+#ifdef __AVR__
+// keep large fleets in check: every member added here costs RAM times the number of drives
+static_assert(sizeof(VFD) <= VFD_SIZE_AVR, "VFD object grew, update VFD_SIZE_AVR and the VFD documentation");
+static_assert(sizeof(VFD_Line) <= VFD_LINE_SIZE_AVR, "VFD_Line grew, update VFD_LINE_SIZE_AVR");
+#endif
 
 
 // Private methods
@@ -35,7 +43,7 @@ bool VFD::isEqual(uint8_t* arr1, uint8_t* arr2, int length) {
 }
 
 // Calcs CRC of the message, LSB first
-uint16_t VFD::calcCrc(uint8_t* buf, int len) {
+uint16_t VFD::calcCrc(const uint8_t* buf, int len) {
   uint16_t crc = 0xFFFF;
   
   for (int pos = 0; pos < len; pos++) {
@@ -55,6 +63,156 @@ uint16_t VFD::calcCrc(uint8_t* buf, int len) {
 }
 
 
+// Adds CRC to the request and sends it to the VFD
+bool VFD::sendRequest(uint8_t* request, uint8_t len) {
+  if(line == NULL) {
+    last_error = VFD_COMM_ERROR_NO_LINE;
+    return false;
+  }
+  Stream* comm_stream = line->comm_stream;
+
+  // the answer to an unacknowledged write could still be on the line
+  while(line->busy());
+
+  // clear receive buffer! bounded, so a babbling line can't keep us here
+  for(uint16_t i = 0; i < VFD_MAX_DRAIN && comm_stream->available(); i++) comm_stream->read();
+
+  uint16_t crc = calcCrc(request, len-2); // calculating crc on all bytes except the 2 CRC ones
+  request[len-2] = (uint8_t)(crc >> 8); // adding crc to the request
+  request[len-1] = (uint8_t)crc;
+
+  line->transceiver.transmit(); // if using a half duplex TTL converter put in transmit mode
+
+  VFD_DELAY(line->min_timing); // 3.5 char time delay
+  comm_stream->write(request, len); // send request
+  if(line->transceiver.getMode() == VFD_DIRECTION_TX_HOOK) {
+    // the TX complete interrupt clears the flag flush() waits for: wait the frame time instead
+    uint32_t written = VFD_MICROS();
+    while(VFD_MICROS() - written < (uint32_t)len*line->char_us);
+  }
+  else {
+    comm_stream->flush(); // waiting end of transmission, the response timeout starts from here
+  }
+  line->transceiver.release();  // getting back to receive mode if needed (the TX complete hook may be first)
+  sent_us = VFD_MICROS();
+
+  if(capture != NULL) capture->record(VFD_CAPTURE_REQUEST, request, len);
+  return true;
+}
+
+// Waits for a response of expected bytes (or a shorter exception response)
+uint8_t VFD::receiveResponse(uint8_t* response, uint8_t expected, uint32_t timeout_us) {
+  uint8_t received = 0;
+  unsigned long started = VFD_MICROS();
+  Stream* comm_stream = line->comm_stream;
+  while(received < expected && VFD_MICROS()-started < timeout_us) { // wait response
+    if(comm_stream->available()) {
+      response[received++] = comm_stream->read();
+      if(received == 5 && (response[1] & 0x80) && expected > 5) break; // exception response is shorter
+    }
+  }
+
+  if(capture != NULL && received > 0) capture->record(VFD_CAPTURE_RESPONSE, response, received);
+  return received;
+}
+
+// Checks a received response: length, CRC, address, function and exceptions
+VFD_Comm_Errors VFD::checkResponse(const uint8_t* response, uint8_t received, uint8_t expected, uint8_t function) {
+  if(received == 0) { // no data received
+    last_error = VFD_COMM_ERROR_NO_RESPONSE;
+    return last_error;
+  }
+
+  // exception response: address, function | 0x80, exception code, CRC
+  bool exception = received == 5 && response[1] == (function | 0x80);
+  uint8_t len = exception ? 5 : expected;
+  if(received < len) { // data size unexpected
+    last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
+    return last_error;
+  }
+
+  // calc crc on the response
+  uint16_t response_crc = calcCrc(response, len-2); // calc on all bytes except 2 CRC bytes
+  if((uint8_t)(response_crc >> 8) != response[len-2] || (uint8_t)response_crc != response[len-1]) { // CRC mismatch
+    last_error = VFD_COMM_ERROR_WRONG_CRC;
+    return last_error;
+  }
+
+  if(response[0] != address) {  // is the device who's calling our device?
+    last_error = VFD_COMM_ERROR_WRONG_DEVICE;
+    return last_error;
+  }
+
+  last_success = VFD_MILLIS(); // the drive saw our request, its dropped line timer restarts
+
+  if(exception) { // request refused by the drive
+    last_error = VFD_COMM_ERROR_EXCEPTION;
+    return last_error;
+  }
+
+  if(response[1] != function) { // valid frame, but not an answer to our request
+    last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
+    return last_error;
+  }
+
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+
+// Stores the polled registers and the state derived from them
+void VFD::storePoll(const uint16_t span[], uint32_t request_us, uint32_t response_us) {
+  // period and jitter of the requests: the drive samples registers when it gets them
+  if(poll_sent_us != 0 || poll_done_us != 0) {
+    uint32_t period = request_us - poll_sent_us;
+    if(poll_period == 0) {
+      poll_period = period;
+    }
+    else {
+      int32_t deviation = (int32_t)(period - poll_period);
+      poll_period += deviation / 8;
+      uint32_t abs_deviation = deviation < 0 ? -deviation : deviation;
+      poll_jitter += ((int32_t)(abs_deviation - poll_jitter)) / 16;
+    }
+  }
+  poll_sent_us = request_us;
+  poll_done_us = response_us;
+
+  // not all the data we need is stored in readed registers, just "bind" the registers we need
+  VFD_PollDecoder<VFD_REGISTER_MAP_SIZE>::decode(span, regs);
+
+  uint16_t operating_command = fetchRaw<VFD_REGISTER_COMMAND>();
+  /// True = FWD - False = BWD
+  direction = (operating_command >> 4) & 1;
+  running = (operating_command >> 1) & 1;
+  last_vfd_error = (VFD_Errors)fetchRaw<VFD_REGISTER_ERROR_CODE>();
+}
+
+
+// Checks a register read back holds what was written
+bool VFD::writeApplied(uint16_t r, uint16_t value, uint16_t actual) {
+  if(r != VFD_REGISTER_COMMAND) return actual == value;
+  // command register holds the last command: direction changes and resets can't be told apart, start/stop can
+  uint16_t mask = (value & (VFD_COMMAND_START | VFD_COMMAND_STOP)) ? (VFD_COMMAND_START | VFD_COMMAND_STOP) : 0;
+  return (actual & mask) == (value & mask);
+}
+
+// Remembers an unacknowledged write for verifyWrites()
+VFD_Comm_Errors VFD::logWrite(uint16_t r, uint16_t value) {
+  uint8_t i = 0;
+  while(i < num_unverified && unverified_regs[i] != r) i++; // a register written again is checked once
+  if(i == VFD_WRITE_LOG) {
+    if(verifyWrites() != VFD_COMM_SUCCESS) return last_error;
+    i = 0;
+  }
+  unverified_regs[i] = r;
+  unverified_values[i] = value;
+  if(i == num_unverified) num_unverified++;
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+
 // Sends a command to the VFD command register
 VFD_Comm_Errors VFD::sendCommand(VFD_Commands c) {
   return writeRegister(VFD_REGISTER_COMMAND, c);
@@ -73,58 +231,38 @@ VFD_Comm_Errors VFD::writeRegister(VFD_Registers r, uint16_t value) {
   //  7. crc low
   //  8. crc high
 
-  while(comm_stream->available()) comm_stream->read(); // clear receive buffer!
-
   // Creating request
   uint8_t request[8] = {address, 0x06, (uint8_t)(r >> 8), (uint8_t)r, (uint8_t)(value >> 8), (uint8_t)value, 0x00, 0x00};
-  uint16_t crc = calcCrc(request, 6); // calculating crc on 6 bytes
-  request[6] = (uint8_t)(crc >> 8); // adding crc to the request
-  request[7] = (uint8_t)crc;
-
+  if(!sendRequest(request, 8)) return last_error;
 
-  if(comm_pin != -1) { // if using a half duplex TTL converter put in trensimt mode
-    digitalWrite(comm_pin, CP_TRANSMIT_LEVEL);
+  VFD_Write_Modes mode = (VFD_Write_Modes)write_mode;
+  if(mode == VFD_WRITE_NO_ACK && r == VFD_REGISTER_COMMAND && (value & VFD_COMMAND_STOP)) {
+    mode = VFD_WRITE_READBACK; // a lost stop is never acceptable
   }
-
-  delay(min_timing); // 3.5 char time delay
-  comm_stream->write(request, 8); // send request
-  comm_stream->flush(); // waiting end of transmission
-
-  if(comm_pin != -1) { // getting back to receive mode if needed
-    digitalWrite(comm_pin, CP_RECEIVE_LEVEL);
+  if(address == 0) {  // broadcast, no drive answers: only the turnaround before the next request
+    line->busy_until = VFD_MICROS() + VFD_PROBE_TURNAROUND_US;
+    last_error = VFD_COMM_SUCCESS;
+    return last_error;
   }
-  
-  // getting response
-  long started = millis();
-  while(comm_stream->available() < 8 && millis()-started < COMM_TIMEOUT_TIME); // wait response
-  // on write register response should be echo of request...
+  if(mode != VFD_WRITE_ECHO) {
+    // the echo is coming anyway: the next request waits for it to be over, then drains it
+    line->busy_until = VFD_MICROS() + VFD_PROBE_TURNAROUND_US + 8UL*line->char_us;
+    if(mode == VFD_WRITE_NO_ACK) {
+      last_success = VFD_MILLIS(); // the request restarts the drive dropped line timer all the same
+      return logWrite(r, value);
+    }
 
-  if(comm_stream->available() != -1 && comm_stream->available() < 8) { // data size mismatch
-    last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
-    return VFD_COMM_ERROR_UNEXPECTED_RESPONSE; // unexpected result...
+    uint16_t actual = readRegister(r);
+    if(last_error != VFD_COMM_SUCCESS) return last_error;
+    if(!writeApplied(r, value, actual)) last_error = VFD_COMM_ERROR_NOT_APPLIED;
+    return last_error;
   }
 
-  if(comm_stream->available() == -1) {  // if nothing in buffer timeout happened
-    last_error = VFD_COMM_ERROR_NO_RESPONSE;
-    return VFD_COMM_ERROR_NO_RESPONSE; // nothing in buffer...
-  }
-  
-  // get the data
+  // getting response
+  // on write register response should be echo of request...
   uint8_t response[8];
-  int i = 0;
-  while(comm_stream->available()) response[i++] = comm_stream->read();
-
-  // calc crc on the response
-  uint16_t response_crc = calcCrc(response, 6); // calc on all bytes except 2 CRC bytes
-  if((uint8_t)(response_crc >> 8) != response[6] || (uint8_t)response_crc != response[7]) { // CRC mismatch
-    last_error = VFD_COMM_ERROR_WRONG_CRC;
-    return VFD_COMM_ERROR_WRONG_CRC;
-  }
-
-  if(response[0] != address) {  // is the device who's calling our device?
-    last_error = VFD_COMM_ERROR_WRONG_DEVICE;
-    return VFD_COMM_ERROR_WRONG_DEVICE;
-  }
+  uint8_t received = receiveResponse(response, 8, COMM_TIMEOUT_TIME*1000UL);
+  if(checkResponse(response, received, 8, 0x06) != VFD_COMM_SUCCESS) return last_error;
 
   if(!isEqual(response, request, 8)) {  // return response should be equal to request
     last_error = VFD_COMM_ERROR_GENERIC;
@@ -132,7 +270,6 @@ VFD_Comm_Errors VFD::writeRegister(VFD_Registers r, uint16_t value) {
   }
 
   // transmission correct
-  last_error = VFD_COMM_SUCCESS;
   return VFD_COMM_SUCCESS;
 }
 
@@ -147,24 +284,13 @@ VFD_Comm_Errors VFD::readMultipleRegisters(VFD_Registers start_register, uint8_t
   //  6. Number of register to read low
   //  7. crc low
   //  8. crc high
-  while(comm_stream->available()) comm_stream->read(); // clear read buffer!
-
-  uint8_t request[8] = {address, 0x03, (uint8_t)(start_register >> 8), (uint8_t)start_register, (uint8_t)(num_register >> 8), (uint8_t)num_register, 0x00, 0x00};
-  uint16_t crc = calcCrc(request, 6); // calculating crc on 6 bytes
-  request[6] = (uint8_t)(crc >> 8); // adding crc to the request
-  request[7] = (uint8_t)crc;
-
-  if(comm_pin != -1) { // if using a half duplex TTL converter put in transimt mode
-    digitalWrite(comm_pin, CP_TRANSMIT_LEVEL);
+  if(num_register == 0 || num_register > VFD_MAX_RANGE_REGISTERS) { // wouldn't fit our buffer
+    last_error = VFD_COMM_ERROR_GENERIC;
+    return last_error;
   }
 
-  delay(min_timing); // 3.5 char time delay
-  comm_stream->write(request, 8);
-  comm_stream->flush(); // waiting end of transmission
-
-  if(comm_pin != -1) { // getting back to receive mode if needed
-    digitalWrite(comm_pin, CP_RECEIVE_LEVEL);
-  }
+  uint8_t request[8] = {address, 0x03, (uint8_t)(start_register >> 8), (uint8_t)start_register, (uint8_t)(num_register >> 8), (uint8_t)num_register, 0x00, 0x00};
+  if(!sendRequest(request, 8)) return last_error;
 
   // response should be
   //  0 - address
@@ -180,51 +306,97 @@ VFD_Comm_Errors VFD::readMultipleRegisters(VFD_Registers start_register, uint8_t
   //  n+x+2 - CRC High
   // so we have 3 bytes "common header" + 2*num_register byte of data + 2 byte CRC
   // => 5 + 2*num_register bytes to read!
-  int byte_to_read = 5+2*num_register;
-
-  long started = millis();
-  while(comm_stream->available() < byte_to_read && millis()-started < COMM_TIMEOUT_TIME); // wait response
+  uint8_t byte_to_read = 5+2*num_register;
 
-  if(comm_stream->available() == 0) { // no data received
-    last_error = VFD_COMM_ERROR_NO_RESPONSE;
-    return last_error; // nothing in buffer...
-  }
+  // get the data
+  uint8_t response[5+2*VFD_MAX_RANGE_REGISTERS];
+  uint8_t received = receiveResponse(response, byte_to_read, COMM_TIMEOUT_TIME*1000UL);
+  if(checkResponse(response, received, byte_to_read, 0x03) != VFD_COMM_SUCCESS) return last_error;
 
-  /*if(comm_stream->available() != 0 && comm_stream->available() < byte_to_read) { // data size unexpected
+  if(response[2] != 2*num_register) { // byte count must match what we asked
     last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
-    return last_error; // unexpected result...
-  }*/
-
-  // get the data
-  uint8_t response[byte_to_read];
-  int i = 0;
-  while(comm_stream->available()) response[i++] = comm_stream->read();
-		
-  // calc crc on the response
-  uint16_t response_crc = calcCrc(response, (byte_to_read-2)); // calc on all bytes except 2 CRC bytes
-  if((uint8_t)(response_crc >> 8) != response[(byte_to_read-2)] || (uint8_t)response_crc != response[(byte_to_read-1)]) { // CRC mismatch
-    last_error = VFD_COMM_ERROR_WRONG_CRC;
     return last_error;
   }
 
-  if(response[0] != address) {  // is the device who's calling our device?
-    last_error = VFD_COMM_ERROR_WRONG_DEVICE;
-    return 0;
-  }
-
   // datas are stored as 2 bytes per register, MSB first
   // cycle throught datas and store them in array
   for(int i = 0; i < num_register; i++) {
     store_arr[i] = response[2*i+3] << 8;
     store_arr[i] |= response[2*i+4];
   }
-  last_error = VFD_COMM_SUCCESS;  // no error to report
+  return last_error;
+}
+
+
+// Writes into multiple consecutive registers at once
+VFD_Comm_Errors VFD::writeMultipleRegisters(uint16_t start_register, uint8_t num_register, const uint16_t values[]) {
+  // request format:
+  //  1. address
+  //  2. operation (write multiple registers (0x10))
+  //  3. First register address high
+  //  4. First register address low
+  //  5. Number of register to write high
+  //  6. Number of register to write low
+  //  7. Byte count (2*num_register)
+  //  n - Data High
+  //  n+1 - Data Low
+  //  ......
+  //  n+x+1 - crc low
+  //  n+x+2 - crc high
+  if(num_register == 0 || num_register > VFD_MAX_RANGE_REGISTERS) {
+    last_error = VFD_COMM_ERROR_GENERIC;
+    return last_error;
+  }
+
+  uint8_t request[9+2*VFD_MAX_RANGE_REGISTERS];
+  uint8_t request_len = 9+2*num_register;
+  request[0] = address;
+  request[1] = 0x10;
+  request[2] = (uint8_t)(start_register >> 8);
+  request[3] = (uint8_t)start_register;
+  request[4] = 0x00;
+  request[5] = num_register;
+  request[6] = 2*num_register;
+  for(uint8_t i = 0; i < num_register; i++) {
+    request[7+2*i] = (uint8_t)(values[i] >> 8);
+    request[8+2*i] = (uint8_t)values[i];
+  }
+  if(!sendRequest(request, request_len)) return last_error;
+
+  // response should be
+  //  0 - address
+  //  1 - function (0x10)
+  //  2 - First register address high
+  //  3 - First register address low
+  //  4 - Number of registers written high
+  //  5 - Number of registers written low
+  //  6 - CRC Low
+  //  7 - CRC High
+  // if the drive doesn't accept the request it answers with a 5 byte exception:
+  //  0 - address
+  //  1 - function | 0x80
+  //  2 - exception code
+  //  3 - CRC Low
+  //  4 - CRC High
+  uint8_t response[8];
+  uint8_t received = receiveResponse(response, 8, COMM_TIMEOUT_TIME*1000UL);
+  if(checkResponse(response, received, 8, 0x10) != VFD_COMM_SUCCESS) return last_error;
+
+  if(!isEqual(response, request, 6)) {  // response should echo start address and register count
+    last_error = VFD_COMM_ERROR_GENERIC;
+    return last_error;
+  }
   return last_error;
 }
 
 
 // Reads a single register
 uint16_t VFD::readRegister(VFD_Registers r) {
+  return readRegister(r, COMM_TIMEOUT_TIME*1000UL);
+}
+
+// Reads a single register, waiting the response at most timeout_us microseconds
+uint16_t VFD::readRegister(VFD_Registers r, uint32_t timeout_us) {
   // request format:
   //  1. address
   //  2. operation (read single register (3))
@@ -234,24 +406,8 @@ uint16_t VFD::readRegister(VFD_Registers r) {
   //  6. Number of register to read low (we want only 1 so...) (1)
   //  7. crc low
   //  8. crc high
-  while(comm_stream->available()) comm_stream->read(); // clear read buffer!
-
   uint8_t request[8] = {address, 0x03, (uint8_t)(r >> 8), (uint8_t)r, 0x00, 0x01, 0x00, 0x00};
-  uint16_t crc = calcCrc(request, 6); // calculating crc on 6 bytes
-  request[6] = (uint8_t)(crc >> 8); // adding crc to the request
-  request[7] = (uint8_t)crc;
-
-  if(comm_pin != -1) { // if using a half duplex TTL converter put in transimt mode
-    digitalWrite(comm_pin, CP_TRANSMIT_LEVEL);
-  }
-
-  delay(min_timing); // 3.5 char time delay
-  comm_stream->write(request, 8);
-  comm_stream->flush(); // waiting end of transmission
-
-  if(comm_pin != -1) { // getting back to receive mode if needed
-    digitalWrite(comm_pin, CP_RECEIVE_LEVEL);
-  }
+  if(!sendRequest(request, 8)) return 0;
 
   // response should be
   //  0 - address
@@ -261,96 +417,160 @@ uint16_t VFD::readRegister(VFD_Registers r) {
   //  4 - Data Low
   //  5 - CRC Low
   //  6 - CRC High
-  long started = millis();
-  while(comm_stream->available() < 7 && millis()-started < COMM_TIMEOUT_TIME); // wait response
-
-  if(comm_stream->available() == 0) { // no data received
-    last_error = VFD_COMM_ERROR_NO_RESPONSE;
-    return 0; // nothing in buffer...
-  }
-
-  if(comm_stream->available() != 0 && comm_stream->available() < 7) { // data size unexpected
-    last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
-    return 0; // unexpected result...
-  }
-  
   // get the data
   uint8_t response[7];
-  int i = 0;
-  while(comm_stream->available()) response[i++] = comm_stream->read();
+  uint8_t received = receiveResponse(response, 7, timeout_us);
+  if(checkResponse(response, received, 7, 0x03) != VFD_COMM_SUCCESS) return 0;
 
-  // calc crc on the response
-  uint16_t response_crc = calcCrc(response, 5); // calc on 5 bytes (avoid received CRC)
-  if((uint8_t)(response_crc >> 8) != response[5] || (uint8_t)response_crc != response[6]) { // CRC mismatch
-    last_error = VFD_COMM_ERROR_WRONG_CRC;
+  if(response[2] != 2) { // byte count of a single register
+    last_error = VFD_COMM_ERROR_UNEXPECTED_RESPONSE;
     return 0;
   }
 
-  if(response[0] != address) {  // is the device who's calling our device?
-    last_error = VFD_COMM_ERROR_WRONG_DEVICE;
-    return 0;
-  }
   // datas are stored as 2 bytes, MSB first
   uint16_t value = (response[3] << 8) | response[4];
-  last_error = VFD_COMM_SUCCESS;  // no error to report
   return value;
 }
 
 
 
 
-// Public methods
-
-// class constructor(s)
-//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream) {
-VFD::VFD(uint8_t _address, Stream& _comm_stream) {
-  comm_stream = &_comm_stream;
+// Sets up the state of a new drive on a line
+void VFD::init(uint8_t _address, VFD_Line* _line) {
   address = _address;
-  baud_rate = 9600;
-  comm_pin = -1;
-  last_error = VFD_COMM_SUCCESS;
+  line = _line;
+  last_error = line != NULL ? VFD_COMM_SUCCESS : VFD_COMM_ERROR_NO_LINE;
   direction = running = false;
+  memset(regs, 0, sizeof(regs));
+  cpu_id = 0;
+  poll_sent_us = poll_done_us = sent_us = 0;
+  poll_period = poll_jitter = 0;
+  multi_write_refused = false;
+  capture = NULL;
+  last_vfd_error = VFD_ERROR_NO_ERROR;
+  last_success = 0;
+  last_keepalive = 0;
+  keepalive_time = 0;
+  write_mode = VFD_WRITE_ECHO;
+  num_unverified = 0;
+}
+
+// Finds the line of a stream and baud in the pool, taking a free one if new
+VFD_Line* VFD::sharedLine(Stream& _comm_stream, uint32_t baud) {
+  // function statics: global drives are built before the globals of other files are
+  static VFD_Line lines[VFD_MAX_LINES];
+  static uint8_t num_lines = 0;
+  static VFD_Line* extra_lines = NULL;  // past the pool, on the heap
 
-  min_timing = 4; // (uint8_t)floor(1000/(baud/10)*3.5f);
+  for(uint8_t i = 0; i < num_lines; i++) {
+    if(lines[i].comm_stream == &_comm_stream && lines[i].baud_rate == baud) return &lines[i];
+  }
+  for(VFD_Line* l = extra_lines; l != NULL; l = l->next) {
+    if(l->comm_stream == &_comm_stream && l->baud_rate == baud) return l;
+  }
+  if(num_lines < VFD_MAX_LINES) {
+    lines[num_lines] = VFD_Line(_comm_stream, baud);
+    return &lines[num_lines++];
+  }
+
+  // pool full: drives live as long as the sketch, so the line is never freed
+  VFD_Line* l = new VFD_Line(_comm_stream, baud);
+  if(l == NULL) return NULL;
+  l->next = extra_lines;
+  extra_lines = l;
+  return l;
+}
+
+
+// Public methods
+
+// class constructor(s)
+VFD_Line::VFD_Line() {
+  comm_stream = NULL;
+  baud_rate = 0;
+  char_us = 0;
+  min_timing = 0;
+  busy_until = 0;
+  next = NULL;
 }
-//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream, int baud) {
-VFD::VFD(uint8_t _address, Stream& _comm_stream, int baud) {
+VFD_Line::VFD_Line(Stream& _comm_stream, uint32_t baud) {
   comm_stream = &_comm_stream;
-  address = _address;
   baud_rate = baud;
-  comm_pin = -1;
-  last_error = VFD_COMM_SUCCESS;
-  direction = running = false;
-
-  min_timing = (uint8_t)floor(1000/(baud/10)*3.5f);
+  char_us = 11000000UL / baud;
+  min_timing = (uint8_t)((35000UL + baud - 1) / baud); // 3.5 chars rounded up, in integers to keep float code out
+  busy_until = 0;
+  next = NULL;
 }
-//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream, int baud, uint8_t _comm_pin) {
-VFD::VFD(uint8_t _address, Stream& _comm_stream, int baud, uint8_t _comm_pin) {
+VFD_Line::VFD_Line(Stream& _comm_stream, uint32_t baud, uint8_t _comm_pin) {
   comm_stream = &_comm_stream;
-  address = _address;
+  transceiver = VFDDirection(_comm_pin);
   baud_rate = baud;
-  comm_pin = _comm_pin;
-  last_error = VFD_COMM_SUCCESS;
-  direction = running = false;
+  char_us = 11000000UL / baud;
+  min_timing = (uint8_t)((35000UL + baud - 1) / baud); // 3.5 chars rounded up, in integers to keep float code out
+  busy_until = 0;
+  next = NULL;
+}
 
-  min_timing = (uint8_t)floor(1000/(baud/10)*3.5f);
+// Checks if the answer of an unacknowledged write can still be on the line
+bool VFD_Line::busy() {
+  uint32_t left = busy_until - VFD_MICROS();
+  if(left == 0 || left > VFD_PROBE_TURNAROUND_US + 8UL*char_us) return false; // the longest wait writeRegister() sets
+  // the receive buffer was drained before the write: 8 bytes in are the whole echo, no need to wait more
+  if(comm_stream->available() >= 8) {
+    busy_until = 0;
+    return false;
+  }
+  return true;
+}
+
+//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream) {
+VFD::VFD(uint8_t _address, Stream& _comm_stream) {
+  init(_address, sharedLine(_comm_stream, 9600));
+}
+//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream, uint32_t baud) {
+VFD::VFD(uint8_t _address, Stream& _comm_stream, uint32_t baud) {
+  init(_address, sharedLine(_comm_stream, baud));
+}
+//VFD::VFD(uint8_t _address, HardwareSerial &_comm_stream, uint32_t baud, uint8_t _comm_pin) {
+VFD::VFD(uint8_t _address, Stream& _comm_stream, uint32_t baud, uint8_t _comm_pin) {
+  init(_address, sharedLine(_comm_stream, baud));
+  if(line != NULL && !line->transceiver.hasPin()) line->transceiver = VFDDirection(_comm_pin);
+}
+VFD::VFD(uint8_t _address, VFD_Line& _line) {
+  init(_address, &_line);
+}
+VFD::VFD(uint8_t _address, VFDBus& bus) {
+  init(_address, &bus.line);
 }
 
 // Class init routine
 void VFD::begin() {
+  if(line == NULL) return;
   // if we have a half-duplex comm we need to initialize pin direction...
-  if(comm_pin != -1) {
-    pinMode(comm_pin, OUTPUT);
-    digitalWrite(comm_pin, CP_RECEIVE_LEVEL); // ... and get in receive mode
-  }
+  line->transceiver.begin(); // ... and get in receive mode
 
   // get fwd/bwd direction data etc...
   // todo...
 }
 
+// Sets how the half-duplex transceiver is switched
+void VFD::setDirectionMode(VFD_Direction_Modes mode) {
+  if(line != NULL) line->transceiver.setMode(mode);
+}
+
+// Switches the transceiver back to receive
+void VFD::txComplete() {
+  if(line != NULL) line->transceiver.txComplete();
+}
+
+// Sets VFD Frequency in 0.1Hz
+VFD_Comm_Errors VFD::setSpeedDeciHz(uint16_t speed) {
+  return writeRegister(VFD_REGISTER_FREQUENCY, speed);
+}
+
 // Sets VFD Frequency
 void VFD::setSpeed(float speed) {
-  writeRegister(VFD_REGISTER_FREQUENCY, (uint16_t)(speed*10));
+  setSpeedDeciHz((uint16_t)(speed*VFD_registerScale(VFD_REGISTER_FREQUENCY) + 0.5f)); // rounded, 10.3*10 would truncate to 102
 }
 
 
@@ -401,12 +621,34 @@ void VFD::resetAllErrors() {
 
 // gets VFD error 
 VFD_Errors VFD::getError() {
-  return readRegister(VFD_REGISTER_ERROR_CODE);
+  uint16_t error = readRegister(VFD_REGISTER_ERROR_CODE);
+  if(last_error == VFD_COMM_SUCCESS) last_vfd_error = (VFD_Errors)error;
+  return (VFD_Errors)error;
 }
 
 // gets frequency the vfd is at
+uint16_t VFD::getRunFreqDeciHz() {
+  return readRegister(VFD_REGISTER_RUN_FREQ);
+}
 float VFD::getRunFreq() {
-  return readRegister(VFD_REGISTER_RUN_FREQ)/10.0f;
+  return getRunFreqDeciHz() / VFD_registerScale(VFD_REGISTER_RUN_FREQ);
+}
+
+// Checks if the drive answers, with a timeout based on the response length
+bool VFD::probe(uint16_t* id) {
+  if(line == NULL) {
+    last_error = VFD_COMM_ERROR_NO_LINE;
+    return false;
+  }
+  // a single register response is 7 bytes, 11 bits per byte (8 data, parity, start and stop)
+  uint32_t timeout_us = VFD_PROBE_TURNAROUND_US + 7UL*line->char_us;
+
+  uint16_t value = readRegister(VFD_REGISTER_UNIQUE_ID, timeout_us);
+  if(last_error != VFD_COMM_SUCCESS) return false;
+
+  cpu_id = value;
+  if(id != NULL) *id = value;
+  return true;
 }
 
 // Get unique CPU ID
@@ -416,47 +658,71 @@ uint16_t VFD::getCpuID() {
 }
 
 // gets the frequency the vfd is trying to reach
+uint16_t VFD::getAimFreqDeciHz() {
+  return readRegister(VFD_REGISTER_AIM_FREQ);
+}
 float VFD::getAimFreq() {
-  return readRegister(VFD_REGISTER_AIM_FREQ)/10.0f;
+  return getAimFreqDeciHz() / VFD_registerScale(VFD_REGISTER_AIM_FREQ);
 }
 
 // gets the output current from the VFD
+uint16_t VFD::getOutCurrentRaw() {
+  return readRegister(VFD_REGISTER_OUT_CURR);
+}
 float VFD::getOutCurrent() {
-  return readRegister(VFD_REGISTER_OUT_CURR); // need multiply?
+  return getOutCurrentRaw() / VFD_registerScale(VFD_REGISTER_OUT_CURR);
 }
 
 // gets the output voltage from the VFD
+uint16_t VFD::getRunVoltageRaw() {
+  return readRegister(VFD_REGISTER_RUN_VOLT);
+}
 float VFD::getRunVoltage() {
-  return readRegister(VFD_REGISTER_RUN_VOLT); // need multiply?
+  return getRunVoltageRaw() / VFD_registerScale(VFD_REGISTER_RUN_VOLT);
 }
 
 // gets the bus voltage from the VFD
+uint16_t VFD::getBusVoltageRaw() {
+  return readRegister(VFD_REGISTER_BUS_VOLT);
+}
 float VFD::getBusVoltage() {
-  return readRegister(VFD_REGISTER_BUS_VOLT); // need multiply?
+  return getBusVoltageRaw() / VFD_registerScale(VFD_REGISTER_BUS_VOLT);
 }
 
-// gets the acceleration time in mS
+// gets the acceleration time in 0.1s
+uint16_t VFD::getAccelTimeDeciSec() {
+  return readRegister(VFD_REGISTER_ACCEL_TIME);
+}
 float VFD::getAccelTime() {
-  return readRegister(VFD_REGISTER_ACCEL_TIME)/10.0f; // need multiply?
+  return getAccelTimeDeciSec() / VFD_registerScale(VFD_REGISTER_ACCEL_TIME);
 }
 
-// sets acceleration time in mS
+// sets acceleration time in 0.1s
+VFD_Comm_Errors VFD::setAccelTimeDeciSec(uint16_t time) {
+  return writeRegister(VFD_REGISTER_ACCEL_TIME, time);
+}
 void VFD::setAccelTime(float time) {
-  return writeRegister(VFD_REGISTER_ACCEL_TIME, (uint16_t)(time*10));
+  setAccelTimeDeciSec((uint16_t)(time*VFD_registerScale(VFD_REGISTER_ACCEL_TIME) + 0.5f));
 }
 
-// gets the deceleration time in mS
+// gets the deceleration time in 0.1s
+uint16_t VFD::getDecelTimeDeciSec() {
+  return readRegister(VFD_REGISTER_DECEL_TIME);
+}
 float VFD::getDecelTime() {
-  return readRegister(VFD_REGISTER_DECEL_TIME)/10.0f; // need multiply?
+  return getDecelTimeDeciSec() / VFD_registerScale(VFD_REGISTER_DECEL_TIME);
 }
 
-// sets acceleration time in mS
+// sets deceleration time in 0.1s
+VFD_Comm_Errors VFD::setDecelTimeDeciSec(uint16_t time) {
+  return writeRegister(VFD_REGISTER_DECEL_TIME, time);
+}
 void VFD::setDecelTime(float time) {
-  return writeRegister(VFD_REGISTER_DECEL_TIME, (uint16_t)(time*10));
+  setDecelTimeDeciSec((uint16_t)(time*VFD_registerScale(VFD_REGISTER_DECEL_TIME) + 0.5f));
 }
 
 // gets last VFD communication error
-char* VFD::lastCommError() {
+const char* VFD::lastCommError() {
   switch(last_error) {
     case VFD_COMM_SUCCESS:
       return "No error";
@@ -470,6 +736,14 @@ char* VFD::lastCommError() {
       return "Generic error";
     case VFD_COMM_ERROR_WRONG_DEVICE:
       return "Wrong device responded";
+    case VFD_COMM_ERROR_EXCEPTION:
+      return "Request refused by device";
+    case VFD_COMM_ERROR_BAD_IMAGE:
+      return "Corrupted parameter image";
+    case VFD_COMM_ERROR_NOT_APPLIED:
+      return "Write not applied";
+    case VFD_COMM_ERROR_NO_LINE:
+      return "No memory for the line";
     default:
       return "Unknown";
   }
@@ -481,7 +755,7 @@ VFD_Comm_Errors VFD::lastCommErrorNum() {
 
 // checks if motor is running
 int VFD::status() {
-  if(getRunFreq() == 0) return 0; // stopped
+  if(getRunFreqDeciHz() == 0) return 0; // stopped
  // if(readRegister(VFD_REGISTER_CURRENT_ACCEL_TIME) < readRegister(VFD_REGISTER_ACCEL_TIME)) return 2;
  // if(readRegister(VFD_REGISTER_CURRENT_DECEL_TIME) < readRegister(VFD_REGISTER_DECEL_TIME)) return 3;
   return 1;
@@ -511,68 +785,364 @@ VFD_Comm_Errors VFD::setParameter(uint8_t section, uint8_t param, uint16_t value
   return writeRegister(reg, value);
 }
 
+// gets values of consecutive parameters of a section
+VFD_Comm_Errors VFD::getParameters(uint8_t section, uint8_t first, uint8_t count, uint16_t values[]) {
+  // split the range in chunks the drive can answer in a single frame
+  while(count > 0) {
+    uint8_t chunk = count > VFD_MAX_RANGE_REGISTERS ? VFD_MAX_RANGE_REGISTERS : count;
+    uint16_t reg = (section << 8) | first;
+    VFD_Comm_Errors error = readMultipleRegisters((VFD_Registers)reg, chunk, values);
+    if(error != VFD_COMM_SUCCESS) return error;
+
+    first += chunk;
+    values += chunk;
+    count -= chunk;
+  }
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+// sets values of consecutive parameters of a section
+VFD_Comm_Errors VFD::setParameters(uint8_t section, uint8_t first, uint8_t count, const uint16_t values[]) {
+  while(count > 0) {
+    uint8_t chunk = count > VFD_MAX_RANGE_REGISTERS ? VFD_MAX_RANGE_REGISTERS : count;
+    uint16_t reg = (section << 8) | first;
+    VFD_Comm_Errors error = VFD_COMM_ERROR_EXCEPTION;
+
+    // a single parameter is cheaper with a plain write, and some drives refuse write-multiple
+    if(chunk > 1 && !multi_write_refused) {
+      error = writeMultipleRegisters(reg, chunk, values);
+      if(error == VFD_COMM_ERROR_EXCEPTION) multi_write_refused = true; // don't try again on this drive
+    }
+    if(error == VFD_COMM_ERROR_EXCEPTION) { // fall back to one write per parameter
+      for(uint8_t i = 0; i < chunk; i++) {
+        error = writeRegister((VFD_Registers)(reg + i), values[i]);
+        if(error != VFD_COMM_SUCCESS) break;
+      }
+    }
+    if(error != VFD_COMM_SUCCESS) return error;
+
+    first += chunk;
+    values += chunk;
+    count -= chunk;
+  }
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+// size of the image needed to store the given ranges
+uint16_t VFD::paramImageSize(const VFD_ParamRange ranges[], uint8_t num_ranges) {
+  uint16_t size = VFD_PARAM_IMAGE_HEADER + 2; // header + CRC
+  for(uint8_t i = 0; i < num_ranges; i++) size += 3 + 2*ranges[i].count;
+  return size;
+}
+
+// reads ranges of parameters and stores them in a serialisable image
+uint16_t VFD::dumpParameters(const VFD_ParamRange ranges[], uint8_t num_ranges, uint8_t image[], uint16_t image_size) {
+  // image format:
+  //  0 - magic (VFD_PARAM_IMAGE_MAGIC)
+  //  1 - version (VFD_PARAM_IMAGE_VERSION)
+  //  2 - cpu id high
+  //  3 - cpu id low
+  //  4 - number of ranges
+  // then for each range:
+  //  n - section
+  //  n+1 - first parameter
+  //  n+2 - parameter count
+  //  n+3.. - 2 bytes per parameter, MSB first
+  // then 2 bytes of CRC (same as the MODBUS one)
+  uint16_t size = paramImageSize(ranges, num_ranges);
+  if(size > image_size) {
+    last_error = VFD_COMM_ERROR_GENERIC;
+    return 0;
+  }
+
+  uint16_t id = getCpuID();
+  if(last_error != VFD_COMM_SUCCESS) return 0;
+
+  image[0] = VFD_PARAM_IMAGE_MAGIC;
+  image[1] = VFD_PARAM_IMAGE_VERSION;
+  image[2] = (uint8_t)(id >> 8);
+  image[3] = (uint8_t)id;
+  image[4] = num_ranges;
+  uint16_t pos = VFD_PARAM_IMAGE_HEADER;
+
+  uint16_t values[VFD_MAX_RANGE_REGISTERS];
+  for(uint8_t r = 0; r < num_ranges; r++) {
+    image[pos++] = ranges[r].section;
+    image[pos++] = ranges[r].first;
+    image[pos++] = ranges[r].count;
+
+    // read in chunks so we don't need a buffer as big as the range
+    uint8_t done = 0;
+    while(done < ranges[r].count) {
+      uint8_t chunk = ranges[r].count - done;
+      if(chunk > VFD_MAX_RANGE_REGISTERS) chunk = VFD_MAX_RANGE_REGISTERS;
+      if(getParameters(ranges[r].section, ranges[r].first + done, chunk, values) != VFD_COMM_SUCCESS) return 0;
+
+      for(uint8_t i = 0; i < chunk; i++) {
+        image[pos++] = (uint8_t)(values[i] >> 8);
+        image[pos++] = (uint8_t)values[i];
+      }
+      done += chunk;
+    }
+  }
+
+  uint16_t crc = calcCrc(image, pos);
+  image[pos++] = (uint8_t)(crc >> 8);
+  image[pos++] = (uint8_t)crc;
+  return pos;
+}
+
+// writes back the parameters of an image which differ from the drive ones
+VFD_Comm_Errors VFD::restoreParameters(const uint8_t image[], uint16_t length) {
+  if(!checkParamImage(image, length)) {
+    last_error = VFD_COMM_ERROR_BAD_IMAGE;
+    return last_error;
+  }
+
+  uint16_t pos = VFD_PARAM_IMAGE_HEADER;
+  uint16_t current[VFD_MAX_RANGE_REGISTERS];
+  uint16_t wanted[VFD_MAX_RANGE_REGISTERS];
+  for(uint8_t r = 0; r < image[4]; r++) {
+    uint8_t section = image[pos++];
+    uint8_t first = image[pos++];
+    uint8_t count = image[pos++];
+
+    uint8_t done = 0;
+    while(done < count) {
+      uint8_t chunk = count - done;
+      if(chunk > VFD_MAX_RANGE_REGISTERS) chunk = VFD_MAX_RANGE_REGISTERS;
+
+      // read what the drive has now with a single range read...
+      VFD_Comm_Errors error = getParameters(section, first + done, chunk, current);
+      if(error != VFD_COMM_SUCCESS) return error;
+      for(uint8_t i = 0; i < chunk; i++) {
+        wanted[i] = (image[pos] << 8) | image[pos+1];
+        pos += 2;
+      }
+
+      // ...and write only runs of parameters that differ
+      uint8_t i = 0;
+      while(i < chunk) {
+        if(current[i] == wanted[i]) {
+          i++;
+          continue;
+        }
+        uint8_t run_start = i;
+        while(i < chunk && current[i] != wanted[i]) i++;
+        error = setParameters(section, first + done + run_start, i - run_start, wanted + run_start);
+        if(error != VFD_COMM_SUCCESS) return error;
+      }
+      done += chunk;
+    }
+  }
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+// checks wether an image is complete and not corrupted
+bool VFD::checkParamImage(const uint8_t image[], uint16_t length) {
+  if(length < VFD_PARAM_IMAGE_HEADER + 2) return false;
+  if(image[0] != VFD_PARAM_IMAGE_MAGIC || image[1] != VFD_PARAM_IMAGE_VERSION) return false;
+
+  // walk the ranges to be sure they fit in the image
+  uint16_t pos = VFD_PARAM_IMAGE_HEADER;
+  for(uint8_t r = 0; r < image[4]; r++) {
+    if(pos + 3 > length - 2) return false;
+    pos += 3 + 2*image[pos+2];
+  }
+  if(pos != length - 2) return false;
+
+  uint16_t crc = calcCrc(image, pos);
+  return (uint8_t)(crc >> 8) == image[pos] && (uint8_t)crc == image[pos+1];
+}
+
+// verifies the drive parameters against an expected configuration
+VFD_Comm_Errors VFD::verifyConfig(const VFD_ParamExpect config[], uint8_t num, VFD_ParamMismatch mismatches[], uint8_t max_mismatches, uint8_t* num_mismatches) {
+  *num_mismatches = 0;
+  uint16_t values[VFD_MAX_RANGE_REGISTERS];
+
+  uint8_t start = 0;
+  while(start < num) {
+    // extend the range while next parameters can be read in the same request
+    uint8_t end = start + 1;
+    while(end < num && VFD_configJoinable(&config[start], &config[end-1], &config[end])) end++;
+
+    uint8_t count = config[end-1].param - config[start].param + 1;
+    VFD_Comm_Errors error = getParameters(config[start].section, config[start].param, count, values);
+    if(error != VFD_COMM_SUCCESS) return error;
+
+    for(uint8_t i = start; i < end; i++) {
+      uint16_t actual = values[config[i].param - config[start].param];
+      if(actual == config[i].value) continue;
+
+      if(*num_mismatches < max_mismatches) {
+        mismatches[*num_mismatches].section = config[i].section;
+        mismatches[*num_mismatches].param = config[i].param;
+        mismatches[*num_mismatches].expected = config[i].value;
+        mismatches[*num_mismatches].actual = actual;
+      }
+      (*num_mismatches)++;
+    }
+    start = end;
+  }
+  last_error = VFD_COMM_SUCCESS;
+  return last_error;
+}
+
+// gets the cpu id of the drive an image was dumped from
+uint16_t VFD::paramImageCpuID(const uint8_t image[]) {
+  return (image[2] << 8) | image[3];
+}
+
 // updates running parametes, to be reched via "fetch" methods
 VFD_Comm_Errors VFD::update() {
-  // we're gonna read 34 registers, skip those we don't need and then map values we need to our running variables
-  uint16_t read_data[34];
-  VFD_Comm_Errors error = readMultipleRegisters(VFD_REGISTER_COMMAND, 34, read_data); // VFD_REGISTER_COMMAND is the lower value address we need
+  // we read the minimal span covering the polled registers of VFD_REGISTER_MAP, all computed at compile time
+  uint16_t read_data[VFD_POLL_SPAN];
+  VFD_Comm_Errors error = readMultipleRegisters((VFD_Registers)VFD_POLL_START, VFD_POLL_SPAN, read_data);
   if(error != VFD_COMM_SUCCESS) return error; // something bad happened! the user will have to figure out what
 
-  // not all the data we need is stored in readed registers, just "bind" the variables we need
-  out_current = read_data[VFD_REGISTER_OUT_CURR-0x2000];
-  run_volt = read_data[VFD_REGISTER_RUN_VOLT-0x2000];
-  bus_volt = read_data[VFD_REGISTER_BUS_VOLT-0x2000];
-  operating_command = read_data[0];
-  
-  // these are stored in VFD as 10x the value
-  accel_time = read_data[VFD_REGISTER_ACCEL_TIME-0x2000];
-  decel_time = read_data[VFD_REGISTER_DECEL_TIME-0x2000];
-  aim_freq = read_data[VFD_REGISTER_AIM_FREQ-0x2000]/10.0f;
-  run_freq = read_data[VFD_REGISTER_RUN_FREQ-0x2000]/10.0f;
-  cpu_id = read_data[VFD_REGISTER_UNIQUE_ID-0x2000];
-  /// True = FWD - False = BWD
-  direction = (operating_command >> 4) & 1;
-  running = (operating_command >> 1) & 1;
+  storePoll(read_data, sent_us, VFD_MICROS());
+  return VFD_COMM_SUCCESS;
+}
+
+// Records the frames exchanged with the drive
+void VFD::setCapture(VFDCapture* _capture) {
+  capture = _capture;
+}
+
+// Sets the drive dropped line timeout to keep alive
+void VFD::setKeepAlive(uint16_t drive_timeout) {
+  keepalive_time = drive_timeout;
+}
+
+// Reads the error register if the drive saw no traffic for too long
+bool VFD::keepAlive() {
+  if(keepalive_time == 0) return false; // disabled
+
+  // leave time for the request to complete, and to retry once on failure; short drive timeouts
+  // get a request every half of it, never closer than a response timeout
+  uint16_t margin = 2*COMM_TIMEOUT_TIME;
+  uint16_t limit = keepalive_time > 2*margin ? keepalive_time - margin : keepalive_time / 2;
+  if(limit < COMM_TIMEOUT_TIME) limit = COMM_TIMEOUT_TIME;
+  uint32_t now = VFD_MILLIS();
+  if(now - last_success < limit) return false; // real traffic kept the drive alive
+
+  // a drive not answering costs a blocking timeout per request: at most one every margin
+  if(now - last_keepalive < (limit > margin ? limit : margin)) return false;
+
+  last_keepalive = now;
+  getError(); // cheapest useful request: a single register read, also refreshes fetchError()
+  return true;
+}
+
+// Sets how writes are acknowledged
+void VFD::setWriteMode(VFD_Write_Modes mode) {
+  write_mode = mode;
+}
+
+// Checks unacknowledged writes were applied, with a single read if they're close
+VFD_Comm_Errors VFD::verifyWrites() {
+  if(num_unverified == 0) return VFD_COMM_SUCCESS;
+
+  uint16_t first = unverified_regs[0], last = unverified_regs[0];
+  for(uint8_t i = 1; i < num_unverified; i++) {
+    if(unverified_regs[i] < first) first = unverified_regs[i];
+    if(unverified_regs[i] > last) last = unverified_regs[i];
+  }
+
+  bool applied = true;
+  if(last - first < VFD_MAX_RANGE_REGISTERS) {
+    uint16_t values[VFD_MAX_RANGE_REGISTERS];
+    if(readMultipleRegisters((VFD_Registers)first, last - first + 1, values) != VFD_COMM_SUCCESS) return last_error;
+    for(uint8_t i = 0; i < num_unverified; i++) {
+      applied &= writeApplied(unverified_regs[i], unverified_values[i], values[unverified_regs[i] - first]);
+    }
+  }
+  else {  // too far apart, one by one
+    for(uint8_t i = 0; i < num_unverified; i++) {
+      uint16_t actual = readRegister((VFD_Registers)unverified_regs[i]);
+      if(last_error != VFD_COMM_SUCCESS) return last_error;
+      applied &= writeApplied(unverified_regs[i], unverified_values[i], actual);
+    }
+  }
+
+  num_unverified = 0;
+  last_error = applied ? VFD_COMM_SUCCESS : VFD_COMM_ERROR_NOT_APPLIED;
+  return last_error;
+}
+
+// Number of writes waiting for verifyWrites()
+uint8_t VFD::unverifiedWrites() {
+  return num_unverified;
+}
+
+// Time from the last successful transaction
+uint32_t VFD::sinceLastComm() {
+  return VFD_MILLIS() - last_success;
+}
+
+// Retrieves last VFD error read from the drive
+VFD_Errors VFD::fetchError() {
+  return last_vfd_error;
+}
+
+// Retrieves a polled register known at runtime
+bool VFD::fetchPolled(uint16_t r, uint16_t* value) {
+  return VFD_PollLookup<VFD_REGISTER_MAP_SIZE>::find(r, regs, value);
 }
 
 // Retrieves Acceleration time from library
 float VFD::fetchAccelTime() {
-  return accel_time;
+  return fetchScaled<VFD_REGISTER_ACCEL_TIME>();
+}
+uint16_t VFD::fetchAccelTimeDeciSec() {
+  return fetchRaw<VFD_REGISTER_ACCEL_TIME>();
 }
 
 // Retrieves Deceleration time from library
 float VFD::fetchDecelTime() {
-  return decel_time;
+  return fetchScaled<VFD_REGISTER_DECEL_TIME>();
+}
+uint16_t VFD::fetchDecelTimeDeciSec() {
+  return fetchRaw<VFD_REGISTER_DECEL_TIME>();
 }
 
 // Retrieves aim frequency from library
 float VFD::fetchAimFrequency() {
-  return aim_freq;
+  return fetchScaled<VFD_REGISTER_AIM_FREQ>();
+}
+uint16_t VFD::fetchAimFrequencyDeciHz() {
+  return fetchRaw<VFD_REGISTER_AIM_FREQ>();
 }
 
 // Retrieves run frequency from library
 float VFD::fetchRunFrequency() {
-  return run_freq;
+  return fetchScaled<VFD_REGISTER_RUN_FREQ>();
+}
+uint16_t VFD::fetchRunFrequencyDeciHz() {
+  return fetchRaw<VFD_REGISTER_RUN_FREQ>();
 }
 
 // Retrieves output current from library
 uint16_t VFD::fetchOutCurrent() {
-  return out_current;
+  return fetchRaw<VFD_REGISTER_OUT_CURR>();
 }
 
 // Retrieves running voltage from library
 uint16_t VFD::fetchRunVoltage() {
-  return run_volt;
+  return fetchRaw<VFD_REGISTER_RUN_VOLT>();
 }
 
 // Retrieves bus voltage from library
 uint16_t VFD::fetchBusVoltage() {
-  return bus_volt;
+  return fetchRaw<VFD_REGISTER_BUS_VOLT>();
 }
 
 // Retrieves command register value
 uint16_t VFD::fetchOperatingCommand() {
-  return operating_command;
+  return fetchRaw<VFD_REGISTER_COMMAND>();
 }
 
 // Retrieves unique id
@@ -599,3 +1169,34 @@ bool VFD::fetchBackward() {
 bool VFD::fetchRunning() {
   return running;
 }
+
+// Retrieves when the last update request was sent
+uint32_t VFD::fetchRequestTime() {
+  return poll_sent_us;
+}
+
+// Retrieves when the last update response was complete
+uint32_t VFD::fetchResponseTime() {
+  return poll_done_us;
+}
+
+// Average time between update requests
+uint32_t VFD::getPollPeriod() {
+  return poll_period;
+}
+
+// Poll period jitter
+uint32_t VFD::getPollJitter() {
+  return poll_jitter;
+}
+
+// Forgets poll period and jitter
+void VFD::resetPollStats() {
+  poll_sent_us = poll_done_us = 0;
+  poll_period = poll_jitter = 0;
+}
+
+// Retrieves if the VFD reached the frequency it's aiming to
+bool VFD::fetchAtSpeed() {
+  return running && fetchRaw<VFD_REGISTER_RUN_FREQ>() == fetchRaw<VFD_REGISTER_AIM_FREQ>();
+}
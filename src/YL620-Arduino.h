@@ -26,17 +26,90 @@
 
 
 #include <Arduino.h>
+#include "VFDDirection.h"
+
+#ifdef VFD_VIRTUAL_TIME
+  // the whole library runs on the virtual clock of VFDSimLine (see VFDSim.h), faster than real time
+  uint32_t VFD_virtualMicros();
+  uint32_t VFD_virtualMillis();
+  void VFD_virtualDelay(uint32_t ms);
+  #define VFD_MICROS() VFD_virtualMicros()
+  #define VFD_MILLIS() VFD_virtualMillis()
+  #define VFD_DELAY(ms) VFD_virtualDelay(ms)
+#endif
+
+#ifndef VFD_MICROS
+  /// Clock of the library, in microseconds
+  #define VFD_MICROS() micros()
+#endif
+
+#ifndef VFD_MILLIS
+  /// Clock of the library, in milliseconds
+  #define VFD_MILLIS() millis()
+#endif
 
-/// Pin level of transmit mode
-#define CP_TRANSMIT_LEVEL HIGH
-/// Pin level of receive mode
-#define CP_RECEIVE_LEVEL  LOW
+#ifndef VFD_DELAY
+  /// Blocking wait of the library, in milliseconds
+  #define VFD_DELAY(ms) delay(ms)
+#endif
 
 #ifndef COMM_TIMEOUT_TIME
   /// Default timeout time
   #define COMM_TIMEOUT_TIME 100
 #endif
 
+#ifndef VFD_MAX_RANGE_REGISTERS
+  /// Max number of registers read or written in a single request (the drive answers at least 34)
+  #define VFD_MAX_RANGE_REGISTERS 34
+#endif
+
+#ifndef VFD_MAX_DRAIN
+  /// Max stale bytes discarded before sending a request
+  #define VFD_MAX_DRAIN 256
+#endif
+
+#ifndef VFD_PROBE_TURNAROUND_US
+  /// Max time the drive takes to start answering a request, used for short timeouts when probing
+  #define VFD_PROBE_TURNAROUND_US 5000
+#endif
+
+#ifndef VFD_MAX_MERGE_GAP
+  /// Max number of unneeded registers read to join two ranges (a new request costs more than ~8 registers)
+  #define VFD_MAX_MERGE_GAP 8
+#endif
+
+#ifndef VFD_WRITE_LOG
+  /// Max unacknowledged writes remembered for verifyWrites() (see VFD_WRITE_NO_ACK)
+  #define VFD_WRITE_LOG 4
+#endif
+
+#ifndef VFD_MAX_LINES
+  /// Lines (stream and baud pairs) of the drives built on a Stream kept in a static pool, see VFD_Line.
+  /// One per hardware serial port of the board, 2 if the core doesn't tell.
+  #if defined(HAVE_HWSERIAL3)
+    #define VFD_MAX_LINES 4
+  #elif defined(HAVE_HWSERIAL2)
+    #define VFD_MAX_LINES 3
+  #else
+    #define VFD_MAX_LINES 2
+  #endif
+#endif
+
+/// RAM of a VFD object on AVR, checked at build time there and by extras/test/sizes.cpp
+#define VFD_SIZE_AVR (60 + 4*VFD_WRITE_LOG)
+/// RAM of a VFD_Line on AVR, checked at build time there and by extras/test/sizes.cpp
+#define VFD_LINE_SIZE_AVR 21
+
+/// First byte of a parameter image
+#define VFD_PARAM_IMAGE_MAGIC 0x59
+/// Format version of a parameter image
+#define VFD_PARAM_IMAGE_VERSION 1
+/// Size of the parameter image header (magic, version, cpu id, number of ranges)
+#define VFD_PARAM_IMAGE_HEADER 5
+
+
+class VFDCapture;
+class VFDBus;
 
 /// List of VFD accepted commands
 enum VFD_Commands : uint8_t {
@@ -70,6 +143,148 @@ enum VFD_Registers : uint16_t {
   VFD_REGISTER_UNIQUE_ID = 0x2021,  ///< CPU Unique ID attributecode 
 };
 
+/// Access allowed on a register
+enum VFD_Register_Access : uint8_t {
+  VFD_ACCESS_READ = 1,  ///< Read only
+  VFD_ACCESS_WRITE = 2, ///< Write only
+  VFD_ACCESS_READ_WRITE = 3,  ///< Read and write
+};
+
+/// Unit of a register value
+enum VFD_Register_Units : uint8_t {
+  VFD_UNIT_NONE = 0,  ///< Flags, codes or ids
+  VFD_UNIT_HZ,  ///< Frequency
+  VFD_UNIT_SECONDS, ///< Time
+  VFD_UNIT_AMPERES, ///< Current
+  VFD_UNIT_VOLTS, ///< Voltage
+};
+
+/// Description of a register, see VFD_REGISTER_MAP
+struct VFD_RegisterDesc {
+  uint16_t address; ///< Register address (VFD_Registers)
+  uint8_t scale;  ///< Raw value is unit value * scale (es. 10 for 0.1Hz)
+  VFD_Register_Units unit;  ///< Unit of the value
+  VFD_Register_Access access; ///< Read/write access
+  bool polled;  ///< Volatile value, refreshed by update() and available via fetch methods
+};
+
+/**
+ * Register map of the drive. The span read by update(), where each polled register is stored
+ * and the fetch accessors are all generated at compile time from this table:
+ * adding a polled register here is all it takes.
+ */
+constexpr VFD_RegisterDesc VFD_REGISTER_MAP[] = {
+  {VFD_REGISTER_COMMAND, 1, VFD_UNIT_NONE, VFD_ACCESS_READ_WRITE, true},
+  {VFD_REGISTER_FREQUENCY, 10, VFD_UNIT_HZ, VFD_ACCESS_READ_WRITE, false},
+  {VFD_REGISTER_ACCEL_TIME, 10, VFD_UNIT_SECONDS, VFD_ACCESS_READ_WRITE, true},
+  {VFD_REGISTER_DECEL_TIME, 10, VFD_UNIT_SECONDS, VFD_ACCESS_READ_WRITE, true},
+  {VFD_REGISTER_ERROR_CODE, 1, VFD_UNIT_NONE, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_AIM_FREQ, 10, VFD_UNIT_HZ, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_RUN_FREQ, 10, VFD_UNIT_HZ, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_OUT_CURR, 1, VFD_UNIT_AMPERES, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_RUN_VOLT, 1, VFD_UNIT_VOLTS, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_BUS_VOLT, 1, VFD_UNIT_VOLTS, VFD_ACCESS_READ, true},
+  {VFD_REGISTER_ACC_DEC_FLAG, 1, VFD_UNIT_NONE, VFD_ACCESS_READ, false},
+  {VFD_REGISTER_CURRENT_ACCEL_TIME, 10, VFD_UNIT_SECONDS, VFD_ACCESS_READ, false},
+  {VFD_REGISTER_CURRENT_DECEL_TIME, 10, VFD_UNIT_SECONDS, VFD_ACCESS_READ, false},
+  {VFD_REGISTER_UNIQUE_ID, 1, VFD_UNIT_NONE, VFD_ACCESS_READ, false}, // never changes, see VFD::getCpuID()
+};
+
+/// Number of registers in VFD_REGISTER_MAP
+constexpr uint8_t VFD_REGISTER_MAP_SIZE = sizeof(VFD_REGISTER_MAP) / sizeof(VFD_REGISTER_MAP[0]);
+
+/**
+ * @brief Position of a register in VFD_REGISTER_MAP
+ * @param address register address
+ * @param i position to start searching from
+ * @return position, VFD_REGISTER_MAP_SIZE if not in the map
+ */
+constexpr uint8_t VFD_registerIndex(uint16_t address, uint8_t i = 0) {
+  return i >= VFD_REGISTER_MAP_SIZE ? VFD_REGISTER_MAP_SIZE
+    : VFD_REGISTER_MAP[i].address == address ? i : VFD_registerIndex(address, i + 1);
+}
+
+/**
+ * @brief Number of polled registers before a position of VFD_REGISTER_MAP (where it's stored by update())
+ * @param i position in the map
+ * @return number of polled registers before i
+ */
+constexpr uint8_t VFD_polledBefore(uint8_t i) {
+  return i == 0 ? 0 : VFD_polledBefore(i - 1) + (VFD_REGISTER_MAP[i-1].polled ? 1 : 0);
+}
+
+/**
+ * @brief Scale of a register of VFD_REGISTER_MAP, for the float API
+ * @param address register address, must be in the map
+ * @return raw value / unit value (es. 10 for 0.1Hz)
+ */
+constexpr float VFD_registerScale(uint16_t address) {
+  return VFD_REGISTER_MAP[VFD_registerIndex(address)].scale;
+}
+
+/// Lowest polled address from position i of VFD_REGISTER_MAP
+constexpr uint16_t VFD_pollStart(uint8_t i = 0) {
+  return i >= VFD_REGISTER_MAP_SIZE ? 0xFFFF
+    : (VFD_REGISTER_MAP[i].polled && VFD_REGISTER_MAP[i].address < VFD_pollStart(i + 1)) ? VFD_REGISTER_MAP[i].address : VFD_pollStart(i + 1);
+}
+
+/// Highest polled address from position i of VFD_REGISTER_MAP
+constexpr uint16_t VFD_pollEnd(uint8_t i = 0) {
+  return i >= VFD_REGISTER_MAP_SIZE ? 0
+    : (VFD_REGISTER_MAP[i].polled && VFD_REGISTER_MAP[i].address > VFD_pollEnd(i + 1)) ? VFD_REGISTER_MAP[i].address : VFD_pollEnd(i + 1);
+}
+
+/// Number of polled registers, size of the register mirror of each VFD
+constexpr uint8_t VFD_POLLED_COUNT = VFD_polledBefore(VFD_REGISTER_MAP_SIZE);
+/// First register read by update()
+constexpr uint16_t VFD_POLL_START = VFD_pollStart();
+/// Number of registers read by update(), the minimal span covering all polled registers
+constexpr uint8_t VFD_POLL_SPAN = VFD_pollEnd() - VFD_pollStart() + 1;
+
+static_assert(VFD_POLLED_COUNT > 0, "no register polled by update()");
+static_assert(VFD_pollEnd() - VFD_pollStart() + 1 <= VFD_MAX_RANGE_REGISTERS, "polled registers don't fit a single read");
+
+/**
+ * Unrolled at compile time: each polled register is copied from the read span to its place
+ * in the mirror, with no table lookup at runtime.
+ * @brief Stores the polled registers of a span read by update()
+ */
+template<uint8_t N>
+struct VFD_PollDecoder {
+  static void decode(const uint16_t span[], uint16_t mirror[]) {
+    VFD_PollDecoder<N-1>::decode(span, mirror);
+    if(VFD_REGISTER_MAP[N-1].polled) mirror[VFD_polledBefore(N-1)] = span[VFD_REGISTER_MAP[N-1].address - VFD_POLL_START];
+  }
+};
+
+/// End of VFD_PollDecoder recursion
+template<>
+struct VFD_PollDecoder<0> {
+  static void decode(const uint16_t[], uint16_t[]) {}
+};
+
+/**
+ * Unrolled at compile time into a chain of compares with constant addresses, so the map
+ * isn't needed in RAM at runtime (it would be, without PROGMEM, on AVR).
+ * @brief Finds a polled register in the mirror of a drive, by address known at runtime
+ */
+template<uint8_t N>
+struct VFD_PollLookup {
+  static bool find(uint16_t r, const uint16_t mirror[], uint16_t* value) {
+    if(VFD_REGISTER_MAP[N-1].polled && r == VFD_REGISTER_MAP[N-1].address) {
+      *value = mirror[VFD_polledBefore(N-1)];
+      return true;
+    }
+    return VFD_PollLookup<N-1>::find(r, mirror, value);
+  }
+};
+
+/// End of VFD_PollLookup recursion
+template<>
+struct VFD_PollLookup<0> {
+  static bool find(uint16_t, const uint16_t[], uint16_t*) { return false; }
+};
+
 /// List of VFD Errors
 enum VFD_Errors : uint16_t {
   VFD_ERROR_NO_ERROR = 0x00,  ///< No error detected
@@ -96,28 +311,147 @@ enum VFD_Comm_Errors : uint8_t {
   VFD_COMM_ERROR_UNEXPECTED_RESPONSE, ///< Response byte count differs from what expected (might need to increase timeout time)
   VFD_COMM_ERROR_GENERIC, ///< When none of the above..
   VFD_COMM_ERROR_WRONG_DEVICE,
+  VFD_COMM_ERROR_EXCEPTION, ///< The drive answered with a MODBUS exception (request not supported)
+  VFD_COMM_ERROR_BAD_IMAGE, ///< Parameter image is truncated or CRC differs
+  VFD_COMM_ERROR_NOT_APPLIED, ///< A written register reads back a different value
+  VFD_COMM_ERROR_NO_LINE, ///< No memory left for a line past the VFD_MAX_LINES pool, the drive has none
+};
+
+/// How single register writes are acknowledged, see VFD::setWriteMode()
+enum VFD_Write_Modes : uint8_t {
+  VFD_WRITE_ECHO = 0, ///< Waits for the drive echo and compares it with the request
+  VFD_WRITE_NO_ACK, ///< Doesn't wait: writes are checked later, all together, by VFD::verifyWrites()
+  VFD_WRITE_READBACK, ///< Doesn't wait for the echo, reads the register back instead
+};
+
+/// Range of consecutive parameters of a section (es. P03.00 - P03.02 is {3, 0, 3})
+struct VFD_ParamRange {
+  uint8_t section;  ///< Parameter section (es. P03.01 section is 03)
+  uint8_t first;  ///< First parameter of the range (es. P03.01 param is 01)
+  uint8_t count;  ///< Number of parameters in the range
+};
+
+
+/// Expected value of a parameter, see VFD::verifyConfig()
+struct VFD_ParamExpect {
+  uint8_t section;  ///< Parameter section (es. P07.08 section is 07)
+  uint8_t param;  ///< Parameter (es. P07.08 param is 08)
+  uint16_t value; ///< Expected value
+};
+
+/// Parameter which differs from the expected configuration, see VFD::verifyConfig()
+struct VFD_ParamMismatch {
+  uint8_t section;  ///< Parameter section
+  uint8_t param;  ///< Parameter
+  uint16_t expected;  ///< Value in the configuration
+  uint16_t actual;  ///< Value read from the drive
+};
+
+/**
+ * @brief Checks if an expected parameter can be read in the same request of a range
+ * @param start first parameter of the range
+ * @param prev last parameter of the range
+ * @param next parameter to add
+ * @return true if next can join the range
+ */
+constexpr bool VFD_configJoinable(const VFD_ParamExpect* start, const VFD_ParamExpect* prev, const VFD_ParamExpect* next) {
+  return next->section == start->section && next->param > prev->param
+    && next->param - start->param < VFD_MAX_RANGE_REGISTERS
+    && next->param - prev->param <= VFD_MAX_MERGE_GAP + 1;
+}
+
+/// Counts the range reads needed after the range starting at start, see VFD_configReads()
+constexpr uint8_t VFD_configReadsAfter(const VFD_ParamExpect* start, const VFD_ParamExpect* config, uint8_t num) {
+  return num == 0 ? 0 :
+    VFD_configJoinable(start, config - 1, config) ? VFD_configReadsAfter(start, config + 1, num - 1)
+    : 1 + VFD_configReadsAfter(config, config + 1, num - 1);
+}
+
+/**
+ * Can be used in a static_assert to check how many requests VFD::verifyConfig() will take.
+ * @brief Number of range reads needed to verify a configuration
+ * @param config expected configuration
+ * @param num number of parameters in config
+ * @return number of read requests
+ */
+constexpr uint8_t VFD_configReads(const VFD_ParamExpect* config, uint8_t num) {
+  return num == 0 ? 0 : 1 + VFD_configReadsAfter(config, config + 1, num - 1);
+}
+
+/**
+ * Parameters must be sorted to be read with the fewest requests, use it in a static_assert.
+ * @brief Checks a configuration is sorted by parameter and without duplicates
+ * @param config expected configuration
+ * @param num number of parameters in config
+ * @return true if sorted
+ */
+constexpr bool VFD_configSorted(const VFD_ParamExpect* config, uint8_t num) {
+  return num < 2 || ((config[0].section < config[1].section
+      || (config[0].section == config[1].section && config[0].param < config[1].param))
+    && VFD_configSorted(config + 1, num - 1));
+}
+
+
+/**
+ * Drives built on the same Stream and baud share one, from a pool of VFD_MAX_LINES:
+ * a drive only keeps a pointer to it. Lines past the pool are allocated on the heap once and
+ * kept for good. VFDBus has its own, shared by the drives built on the bus.
+ * @brief Settings and state of a RS485 line, shared by its drives
+ */
+struct VFD_Line {
+  Stream* comm_stream;  ///< Stream class used for communication
+  VFDDirection transceiver; ///< Transmit/receive switching of the half-duplex converter (no pin if not needed)
+  uint32_t baud_rate; ///< Communication baud (Param P03.00)
+  uint16_t char_us; ///< Time of a character on the line (11 bits), in microseconds
+  uint8_t min_timing; ///< MODBUS RTU requires 3.5 chars of silence before a request, in ms
+  uint32_t busy_until;  ///< micros() until the answer of an unacknowledged write can still be on the line
+  VFD_Line* next; ///< Next line allocated past the pool (NULL if none)
+
+  /**
+     * @brief Constructor, of an unused line
+  */
+  VFD_Line();
+
+  /**
+     * @brief Constructor, for full-duplex adapters
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+     * @param baud communication baudrate (param P03.00).
+  */
+  VFD_Line(Stream& _comm_stream, uint32_t baud);
+
+  /**
+     * @brief Constructor.
+     * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
+     * @param baud communication baudrate (param P03.00).
+     * @param _comm_pin Arduino pin for commutating trasmit/receive mode.
+  */
+  VFD_Line(Stream& _comm_stream, uint32_t baud, uint8_t _comm_pin);
+
+  /**
+     * Only a wait up to the longest one set counts, so a busy_until left from long ago doesn't
+     * look like the future once micros() went past half its range.
+     * Ends as soon as the whole echo of the write is received, a drive answers well before the worst case.
+     * @brief Checks if the answer of an unacknowledged write can still be on the line
+     * @return true until busy_until, or until the echo is received
+  */
+  bool busy();
 };
 
 
 /**
+ * Only the per-drive state is kept in the object (on AVR VFD_SIZE_AVR: 60 bytes + 4 per VFD_WRITE_LOG entry):
+ * the line settings are shared, see VFD_Line.
  * @brief VFD class for inverter control
  */
 class VFD {
+  friend class VFDBus;
+  friend class VFDSimLine;
+
   /// MODBUS address of inverter (param P03.01)
   uint8_t address;
 
-  /// Stream class used for communication
-  //HardwareSerial* comm_stream;
-  Stream* comm_stream;  
-
-  /// Arduino pin for half-duplex converter. Setted at -1 if not needed
-  int comm_pin;
-
-  /// MODBUS RTU requires a 3.5char timing space before comm. Calculating how many ms and storing them here
-  uint8_t min_timing;
-
-  /// Communication baud (Param P03.00)
-  uint8_t baud_rate;
+  /// Line the drive is on (NULL if no memory was left for it)
+  VFD_Line* line;
 
   /**
      * @defgroup runparam Running parameters
@@ -126,25 +460,48 @@ class VFD {
      * @see update();
      * @{
   */
-  float accel_time;  ///< Acceleration time
-  float decel_time; ///< Deceleration time
-  float aim_freq;  ///< Frequency the inverter is trying to reach
-  float run_freq; ///< Frequency the inverter is now running at
-  uint16_t out_current; ///< Current to the motor
-  uint16_t run_volt;  ///< Running voltage
-  uint16_t bus_volt;  ///< VFD Bus voltage
-  uint16_t operating_command; ///< VFD command register status
+  uint16_t regs[VFD_POLLED_COUNT]; ///< Raw polled registers, in VFD_REGISTER_MAP order (see fetchRaw())
   uint16_t cpu_id;  ///< Unique VFD ID
-  bool direction; ///< True = FWD - False = BWD
-  bool running; ///< Is the motor running?
+  uint32_t poll_sent_us;  ///< micros() the update request was sent at
+  uint32_t poll_done_us;  ///< micros() the update response was complete at
+  bool direction : 1; ///< True = FWD - False = BWD
+  bool running : 1; ///< Is the motor running?
   /** @}*/
 
+  /// Set when the drive answered write-multiple with an exception, so we use single writes
+  bool multi_write_refused : 1;
+
+  /// How single register writes are acknowledged (a VFD_Write_Modes)
+  uint8_t write_mode : 2;
+
   /// Last error, triggered from VFD_REGISTER_ERROR_CODE
   VFD_Errors last_vfd_error;
   
   /// Last library error
   VFD_Comm_Errors last_error;
 
+  /// millis() of the last successful transaction (or unacknowledged write, the drive saw it too)
+  uint32_t last_success;
+
+  /// millis() of the last keep-alive request, answered or not
+  uint32_t last_keepalive;
+
+  /// Drive dropped line timeout in ms (0 keep-alive disabled)
+  uint16_t keepalive_time;
+
+  /// Where frames are recorded (NULL if not capturing)
+  VFDCapture* capture;
+
+  /// micros() the last request was sent at (last byte out)
+  uint32_t sent_us;
+
+  uint32_t poll_period; ///< Average time between update requests, in microseconds (0 no data yet)
+  uint32_t poll_jitter; ///< Average deviation of the time between update requests from poll_period, in microseconds
+
+  uint16_t unverified_regs[VFD_WRITE_LOG];  ///< Registers written without acknowledge
+  uint16_t unverified_values[VFD_WRITE_LOG];  ///< Values written without acknowledge
+  uint8_t num_unverified; ///< Writes waiting for verifyWrites()
+
 
   /**
      * @brief Checks wether 2 arrays are equal
@@ -161,7 +518,61 @@ class VFD {
      * @param len length of the buffer
      * @return 2 byte CRC (LSB fisrt)
   */
-  uint16_t calcCrc(uint8_t* buf, int len);
+  static uint16_t calcCrc(const uint8_t* buf, int len);
+
+  /**
+     * @brief Adds CRC to the request and sends it, switching the transceiver if needed
+     * @param request buffer of the request, last 2 bytes are filled with the CRC
+     * @param len length of the request (CRC included)
+     * @return false if the drive has no line (last_error VFD_COMM_ERROR_NO_LINE)
+  */
+  bool sendRequest(uint8_t* request, uint8_t len);
+
+  /**
+     * @brief Waits for a response, stops early on a MODBUS exception response (5 bytes)
+     * @param response buffer that will contain the response (at least expected bytes)
+     * @param expected length of the response
+     * @param timeout_us max time to wait for the response, in microseconds
+     * @return number of bytes received
+  */
+  uint8_t receiveResponse(uint8_t* response, uint8_t expected, uint32_t timeout_us);
+
+  /**
+     * Sets last_error too. A valid frame from the drive (even an exception) restarts the keep-alive time.
+     * @brief Checks length, CRC, address and function of a response
+     * @param response received bytes
+     * @param received number of received bytes
+     * @param expected length of a correct response
+     * @param function MODBUS function of the request
+     * @return Error or VFD_COMM_SUCCESS if ok
+  */
+  VFD_Comm_Errors checkResponse(const uint8_t* response, uint8_t received, uint8_t expected, uint8_t function);
+
+  /**
+     * @brief Stores the polled registers, the state derived from them and their timing
+     * @param span registers read from VFD_POLL_START, VFD_POLL_SPAN long
+     * @param request_us micros() the request was sent at
+     * @param response_us micros() the response was complete at
+  */
+  void storePoll(const uint16_t span[], uint32_t request_us, uint32_t response_us);
+
+  /**
+     * Command register reads back the last command: only its start/stop bits are compared.
+     * @brief Checks a register read back holds what was written
+     * @param r register written
+     * @param value value written
+     * @param actual value read back
+     * @return true if the write was applied
+  */
+  static bool writeApplied(uint16_t r, uint16_t value, uint16_t actual);
+
+  /**
+     * @brief Remembers an unacknowledged write for verifyWrites()
+     * @param r register written
+     * @param value value written
+     * @return error of verifyWrites() if the log was full, VFD_COMM_SUCCESS otherwise
+  */
+  VFD_Comm_Errors logWrite(uint16_t r, uint16_t value);
 
   /**
      * @brief Sends a command (writing on the command register)
@@ -181,12 +592,21 @@ class VFD {
   /**
      * @brief Reads multiple registers at once
      * @param start_register Address of the first register to read
-     * @param num_register Number of registers to read
+     * @param num_register Number of registers to read (max VFD_MAX_RANGE_REGISTERS)
      * @param store_arr Pointer to the array wich will contain the datas
      * @return Error or VFD_COMM_SUCCESS if ok
   */
   VFD_Comm_Errors readMultipleRegisters(VFD_Registers start_register, uint8_t num_register, uint16_t store_arr[]);
 
+  /**
+     * @brief Writes multiple consecutive registers at once
+     * @param start_register Address of the first register to write
+     * @param num_register Number of registers to write (max VFD_MAX_RANGE_REGISTERS)
+     * @param values Values to write
+     * @return Error or VFD_COMM_SUCCESS if ok
+  */
+  VFD_Comm_Errors writeMultipleRegisters(uint16_t start_register, uint8_t num_register, const uint16_t values[]);
+
   /**
      * @brief Reads from a register
      * @param r register to read
@@ -194,53 +614,119 @@ class VFD {
   */
   uint16_t readRegister(VFD_Registers r);
 
+  /**
+     * @brief Reads from a register with a custom timeout
+     * @param r register to read
+     * @param timeout_us max time to wait for the response, in microseconds
+     * @return 2 byte register content
+  */
+  uint16_t readRegister(VFD_Registers r, uint32_t timeout_us);
+
+  /**
+     * @brief Sets up the state of a new drive
+     * @param _address address of the VFD (param P03.01).
+     * @param _line line the drive is on (NULL if none)
+  */
+  void init(uint8_t _address, VFD_Line* _line);
+
+  /**
+     * Past VFD_MAX_LINES lines a new one is allocated on the heap.
+     * @brief Finds the line of a stream and baud in the pool, taking a free one if new
+     * @param _comm_stream communication stream
+     * @param baud communication baudrate
+     * @return shared line, NULL if no memory was left for a new one
+  */
+  static VFD_Line* sharedLine(Stream& _comm_stream, uint32_t baud);
+
 
 public:
   /**
      * Create a new VFD object. Required params address and comm_stream. If no baud specified used 9600.
      * If no comm_pin specified doesn't switch during comm (use with full-duplex adapter).
+     * Drives with the same stream and baud share their line (see VFD_Line, VFD_MAX_LINES).
      * @brief Constructor.
      * @param _address address of the VFD (param P03.01).
      * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
-     * @see VFD(uint8_t _address, Stream &_comm_stream, int baud);
-     * @see VFD(uint8_t _address, Stream &_comm_stream, int baud, uint8_t _comm_pin);
+     * @see VFD(uint8_t _address, Stream &_comm_stream, uint32_t baud);
+     * @see VFD(uint8_t _address, Stream &_comm_stream, uint32_t baud, uint8_t _comm_pin);
   */
   //VFD(uint8_t _address, HardwareSerial& _comm_stream);
   VFD(uint8_t _address, Stream& _comm_stream);
   /**
      * Create a new VFD object. Required params address and comm_stream. If no baud specified used 9600.
      * If no comm_pin specified doesn't switch during comm (use with full-duplex adapter).
+     * Drives with the same stream and baud share their line (see VFD_Line, VFD_MAX_LINES).
      * @brief Constructor.
      * @param _address address of the VFD (param P03.01).
      * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
      * @param baud VFD communication baudrate (param P03.00).
      * @see VFD(uint8_t _address, Stream &_comm_stream);
-     * @see VFD(uint8_t _address, Stream &_comm_stream, int baud, uint8_t _comm_pin);
+     * @see VFD(uint8_t _address, Stream &_comm_stream, uint32_t baud, uint8_t _comm_pin);
   */
-  //VFD(uint8_t _address, HardwareSerial& _comm_stream, int baud);
-  VFD(uint8_t _address, Stream& _comm_stream, int baud);
+  //VFD(uint8_t _address, HardwareSerial& _comm_stream, uint32_t baud);
+  VFD(uint8_t _address, Stream& _comm_stream, uint32_t baud);
   /**
      * Create a new VFD object. Required params address and comm_stream. If no baud specified used 9600.
      * If no comm_pin specified doesn't switch during comm (use with full-duplex adapter).
+     * Drives with the same stream and baud share their line (see VFD_Line, VFD_MAX_LINES).
      * @brief Constructor.
      * @param _address address of the VFD (param P03.01).
      * @param _comm_stream communication stream (Serial1, Serial, VirtualSerial, ecc...).
      * @param baud VFD communication baudrate (param P03.00).
      * @param _comm_pin Arduino pin for commutating trasmit/receive mode.
      * @see VFD(uint8_t _address, Stream &_comm_stream);
-     * @see VFD(uint8_t _address, Stream &_comm_stream, int baud);
+     * @see VFD(uint8_t _address, Stream &_comm_stream, uint32_t baud);
+  */
+  //VFD(uint8_t _address, HardwareSerial& _comm_stream, uint32_t baud, uint8_t _comm_pin);
+  VFD(uint8_t _address, Stream& _comm_stream, uint32_t baud, uint8_t _comm_pin);
+  /**
+     * @brief Constructor, on a line set up by the sketch (es. to keep lines past VFD_MAX_LINES off the heap)
+     * @param _address address of the VFD (param P03.01).
+     * @param _line line the drive is on, must outlive the drive
+  */
+  VFD(uint8_t _address, VFD_Line& _line);
+  /**
+     * Blocking methods can be used too, when no transaction is pending.
+     * @brief Constructor, on the line of a VFDBus
+     * @param _address address of the VFD (param P03.01).
+     * @param bus line the drive is on
   */
-  //VFD(uint8_t _address, HardwareSerial& _comm_stream, int baud, uint8_t _comm_pin);
-  VFD(uint8_t _address, Stream& _comm_stream, int baud, uint8_t _comm_pin);
+  VFD(uint8_t _address, VFDBus& bus);
 
   /**
      * @brief First call for pin settings
   */
   void begin();
 
+  /**
+     * With a pin the transceiver is switched by digitalWrite() (VFD_DIRECTION_DIGITAL).
+     * VFD_DIRECTION_PORT switches it by a port register write, VFD_DIRECTION_TX_HOOK lets txComplete()
+     * release it as soon as the last stop bit is out. Blocking requests still wait the end of
+     * transmission, their response timeout starts there: with VFD_DIRECTION_TX_HOOK they wait the
+     * frame time instead of flush(), which never returns once the interrupt cleared the TX complete
+     * flag (see the TxCompleteHook example). Applies to all the drives of the line.
+     * @brief Sets how the half-duplex transceiver is switched, call it before begin()
+     * @param mode direction mode
+  */
+  void setDirectionMode(VFD_Direction_Modes mode);
+
+  /**
+     * Call it from the serial TX complete interrupt when using VFD_DIRECTION_TX_HOOK.
+     * @brief Switches the transceiver back to receive
+  */
+  void txComplete();
+
+  /**
+     * @brief Sets frequency on the VFD
+     * @param speed frequency in 0.1Hz (es. 105 is 10.5Hz)
+     * @return communication error enum
+  */
+  VFD_Comm_Errors setSpeedDeciHz(uint16_t speed);
+
   /**
      * @brief Sets frequency on the VFD
      * @param speed float of speed (max 1 decimal unit)
+     * @see setSpeedDeciHz()
   */
   void setSpeed(float speed);
 
@@ -295,9 +781,16 @@ public:
   */
   VFD_Errors getError();
 
+  /**
+     * @brief get actual running frequency
+     * @return running frequency in 0.1Hz
+  */
+  uint16_t getRunFreqDeciHz();
+
   /**
      * @brief get actual running frequency
      * @return running frequency in Hz
+     * @see getRunFreqDeciHz()
   */
   float getRunFreq();
 
@@ -307,24 +800,58 @@ public:
   */
   uint16_t getCpuID();
 
+  /**
+     * Reads the unique id waiting only the time needed by the response (VFD_PROBE_TURNAROUND_US
+     * plus 7 chars at the drive baud), so a missing drive is detected in few ms.
+     * @brief Checks if the drive answers
+     * @param id will contain the cpu id of the drive if it answers (can be NULL)
+     * @return true if the drive answered correctly
+  */
+  bool probe(uint16_t* id);
+
+  /**
+     * @brief get target running frequency
+     * @return running frequency in 0.1Hz
+  */
+  uint16_t getAimFreqDeciHz();
+
   /**
      * @brief get target running frequency
      * @return running frequency in Hz
+     * @see getAimFreqDeciHz()
   */
   float getAimFreq();
 
+  /**
+     * @brief get actual output current
+     * @return raw out current register
+  */
+  uint16_t getOutCurrentRaw();
+
   /**
      * @brief get actual output current
      * @return out current in Amperes
   */
   float getOutCurrent();
 
+  /**
+     * @brief get actual running voltage
+     * @return raw running voltage register
+  */
+  uint16_t getRunVoltageRaw();
+
   /**
      * @brief get actual running voltage
      * @return out voltage in Volts
   */
   float getRunVoltage();
 
+  /**
+     * @brief Get actual bus voltage
+     * @return raw bus voltage register
+  */
+  uint16_t getBusVoltageRaw();
+
   /**
      * @brief Get actual bus voltage
      * @return Bus voltage in Volts
@@ -333,25 +860,55 @@ public:
 
   /**
      * @brief Get actual acceleration time
-     * @return Acceleration time in ms
+     * @return Acceleration time in 0.1s
+  */
+  uint16_t getAccelTimeDeciSec();
+
+  /**
+     * @brief Get actual acceleration time
+     * @return Acceleration time in seconds
+     * @see getAccelTimeDeciSec()
   */
   float getAccelTime();
 
   /**
      * @brief Sets acceleration time
-     * @param time Acceleration time in ms
+     * @param time Acceleration time in 0.1s
+     * @return communication error enum
+  */
+  VFD_Comm_Errors setAccelTimeDeciSec(uint16_t time);
+
+  /**
+     * @brief Sets acceleration time
+     * @param time Acceleration time in seconds
+     * @see setAccelTimeDeciSec()
   */
   void setAccelTime(float time);
 
   /**
      * @brief Get actual deceleration time
-     * @return Deceleration time in ms
+     * @return Deceleration time in 0.1s
+  */
+  uint16_t getDecelTimeDeciSec();
+
+  /**
+     * @brief Get actual deceleration time
+     * @return Deceleration time in seconds
+     * @see getDecelTimeDeciSec()
   */
   float getDecelTime();
 
   /**
      * @brief Sets deceleration time
-     * @param time Deceleration time in ms
+     * @param time Deceleration time in 0.1s
+     * @return communication error enum
+  */
+  VFD_Comm_Errors setDecelTimeDeciSec(uint16_t time);
+
+  /**
+     * @brief Sets deceleration time
+     * @param time Deceleration time in seconds
+     * @see setDecelTimeDeciSec()
   */
   void setDecelTime(float time);
 
@@ -359,7 +916,7 @@ public:
      * @brief Get last library (communication) error as human readable
      * @return Human readable last error (C-style string)
   */
-  char* lastCommError();
+  const char* lastCommError();
   
   /**
      * @brief Get last library (communication) error
@@ -402,26 +959,229 @@ public:
   */
   VFD_Comm_Errors setParameter(uint8_t section, uint8_t param, uint16_t value);
 
+  /**
+     * Reads the range with as few requests as possible (VFD_MAX_RANGE_REGISTERS per request).
+     * @brief Get consecutive parameters of a section
+     * @param section parameter section (es. P03.00 section is 03)
+     * @param first first parameter (es. P03.00 param is 00)
+     * @param count number of parameters to read
+     * @param values array that will contain the parameters (at least count long)
+     * @return communication error enum
+  */
+  VFD_Comm_Errors getParameters(uint8_t section, uint8_t first, uint8_t count, uint16_t values[]);
+
+  /**
+     * Uses write-multiple requests, falling back to one write per parameter if the drive refuses them.
+     * @brief Set consecutive parameters of a section
+     * @param section parameter section (es. P03.00 section is 03)
+     * @param first first parameter (es. P03.00 param is 00)
+     * @param count number of parameters to write
+     * @param values values to set
+     * @return communication error enum
+  */
+  VFD_Comm_Errors setParameters(uint8_t section, uint8_t first, uint8_t count, const uint16_t values[]);
+
+  /**
+     * @brief Size of the image needed to dump the given ranges
+     * @param ranges ranges of parameters to dump
+     * @param num_ranges number of ranges
+     * @return size of the image in bytes
+     * @see dumpParameters()
+  */
+  static uint16_t paramImageSize(const VFD_ParamRange ranges[], uint8_t num_ranges);
+
+  /**
+     * Reads ranges of parameters and stores them with the drive cpu id and a CRC in a compact image,
+     * that can be saved (EEPROM, SD, Serial...) and restored later.
+     * @brief Dump parameters to an image
+     * @param ranges ranges of parameters to dump
+     * @param num_ranges number of ranges
+     * @param image buffer that will contain the image
+     * @param image_size size of the buffer
+     * @return size of the image, 0 on error (see lastCommErrorNum())
+     * @see paramImageSize()
+     * @see restoreParameters()
+  */
+  uint16_t dumpParameters(const VFD_ParamRange ranges[], uint8_t num_ranges, uint8_t image[], uint16_t image_size);
+
+  /**
+     * Reads the parameters of the image from the drive and writes only the ones that differ.
+     * @brief Restore parameters from an image
+     * @param image image created with dumpParameters()
+     * @param length size of the image
+     * @return communication error enum, VFD_COMM_ERROR_BAD_IMAGE if the image is corrupted
+     * @see dumpParameters()
+  */
+  VFD_Comm_Errors restoreParameters(const uint8_t image[], uint16_t length);
+
+  /**
+     * @brief Checks an image is complete and its CRC is correct
+     * @param image image created with dumpParameters()
+     * @param length size of the image
+     * @return true if the image is valid
+  */
+  static bool checkParamImage(const uint8_t image[], uint16_t length);
+
+  /**
+     * @brief Gets the cpu id of the drive the image was dumped from
+     * @param image image created with dumpParameters()
+     * @return raw cpu id
+  */
+  static uint16_t paramImageCpuID(const uint8_t image[]);
+
+  /**
+     * Reads all the parameters of config, joining near parameters of a section in a single range read,
+     * and reports the ones which differ from the expected value.
+     * Keep config sorted (see VFD_configSorted()) to use as few requests as possible.
+     * @brief Verify the drive parameters against an expected configuration
+     * @param config expected configuration
+     * @param num number of parameters in config
+     * @param mismatches array that will contain the parameters that differ
+     * @param max_mismatches size of mismatches array
+     * @param num_mismatches will contain the number of parameters that differ (can be more than max_mismatches)
+     * @return communication error enum
+     * @see VFD_configReads()
+  */
+  VFD_Comm_Errors verifyConfig(const VFD_ParamExpect config[], uint8_t num, VFD_ParamMismatch mismatches[], uint8_t max_mismatches, uint8_t* num_mismatches);
+
   /**
      * @brief Retrieves all the running parameter of the inverter
      * @return communication error enum
   */
   VFD_Comm_Errors update();
 
+  /**
+     * @brief Records every request and response frame exchanged with the drive
+     * @param _capture capture buffer (NULL stops capturing)
+     * @see VFDCapture
+  */
+  void setCapture(VFDCapture* _capture);
+
+  /**
+     * Set it according to the drive RS485 dropped line timeout: keepAlive() will send a request
+     * only if no other request reached the drive in the meantime.
+     * @brief Enables keep-alive requests
+     * @param drive_timeout drive dropped line timeout in ms (0 disables keep-alive)
+     * @see keepAlive()
+  */
+  void setKeepAlive(uint16_t drive_timeout);
+
+  /**
+     * Call it often (es. every loop()). When the time from the last successful transaction gets
+     * near the drive timeout (2*COMM_TIMEOUT_TIME before it, at least half of it), reads the error
+     * register, the cheapest request, so the drive doesn't stop with VFD_ERROR_RS485.
+     * A drive not answering gets a request (and its blocking wait) at most every
+     * 2*COMM_TIMEOUT_TIME, not at every call.
+     * @brief Keeps the drive communication alive
+     * @return true if a keep-alive request was sent
+     * @see setKeepAlive()
+     * @see fetchError()
+  */
+  bool keepAlive();
+
+  /**
+     * VFD_WRITE_NO_ACK is meant for bulk commissioning and broadcast (address 0, drives never
+     * answer): it doesn't wait for the drive, the next request waits only for the line to be free.
+     * A stop command is never left unacknowledged, it's read back.
+     * Applies to single register writes: commands, speed, ramp times, setParameter().
+     * @brief Sets how writes are acknowledged (default VFD_WRITE_ECHO)
+     * @param mode acknowledge mode
+     * @see verifyWrites()
+  */
+  void setWriteMode(VFD_Write_Modes mode);
+
+  /**
+     * With VFD_WRITE_NO_ACK the last VFD_WRITE_LOG writes are remembered: they're read back
+     * with as few requests as possible (one if they're close). Called by itself when the log is full.
+     * @brief Checks unacknowledged writes were applied
+     * @return VFD_COMM_ERROR_NOT_APPLIED if a register holds a different value, or comm error
+  */
+  VFD_Comm_Errors verifyWrites();
+
+  /**
+     * @brief Number of writes waiting for verifyWrites()
+     * @return number of unacknowledged writes
+  */
+  uint8_t unverifiedWrites();
+
+  /**
+     * Unacknowledged writes (VFD_WRITE_NO_ACK) count as successful: the drive saw them.
+     * @brief Time from the last successful transaction with the drive
+     * @return time in ms
+  */
+  uint32_t sinceLastComm();
+
+  /**
+     * @brief Retrieves last VFD error from library
+     * @return last error read by getError() or keepAlive()
+  */
+  VFD_Errors fetchError();
+
+  /**
+     * Checked at compile time: fails to build if the register isn't polled by update().
+     * @brief Retrieves a raw polled register from library
+     * @tparam R register to fetch
+     * @return raw register value (see VFD_REGISTER_MAP for its scale)
+     * @see update()
+  */
+  template<VFD_Registers R>
+  uint16_t fetchRaw() {
+    static_assert(VFD_registerIndex(R) < VFD_REGISTER_MAP_SIZE, "register not in VFD_REGISTER_MAP");
+    static_assert(VFD_REGISTER_MAP[VFD_registerIndex(R)].polled, "register not polled by update()");
+    return regs[VFD_polledBefore(VFD_registerIndex(R))];
+  }
+
+  /**
+     * Checked at compile time: fails to build if the register isn't polled by update() or has no unit.
+     * @brief Retrieves a polled register from library, in its unit
+     * @tparam R register to fetch
+     * @return register value divided by its scale in VFD_REGISTER_MAP
+     * @see fetchRaw()
+  */
+  template<VFD_Registers R>
+  float fetchScaled() {
+    static_assert(VFD_REGISTER_MAP[VFD_registerIndex(R)].unit != VFD_UNIT_NONE, "register has no unit, use fetchRaw()");
+    return fetchRaw<R>() / VFD_registerScale(R);
+  }
+
+  /**
+     * Runtime version of fetchRaw(), for registers known only at runtime.
+     * @brief Retrieves a raw polled register from library
+     * @param r register address
+     * @param value where the raw value is stored
+     * @return false if r isn't polled by update()
+     * @see update()
+  */
+  bool fetchPolled(uint16_t r, uint16_t* value);
+
   /**
      * @brief Retrieves Acceleration time from library
-     * @return Acceleration time in ms
+     * @return Acceleration time in seconds
      * @see update()
   */
   float fetchAccelTime();
 
+  /**
+     * @brief Retrieves Acceleration time from library
+     * @return Acceleration time in 0.1s
+     * @see update()
+  */
+  uint16_t fetchAccelTimeDeciSec();
+
   /**
      * @brief Retrieves Deceleration time from library
-     * @return Deceleration time in ms
+     * @return Deceleration time in seconds
      * @see update()
   */
   float fetchDecelTime();
 
+  /**
+     * @brief Retrieves Deceleration time from library
+     * @return Deceleration time in 0.1s
+     * @see update()
+  */
+  uint16_t fetchDecelTimeDeciSec();
+
   /**
      * @brief Retrieves aim frequency from library
      * @return Frequency vfd is trying to reach
@@ -429,6 +1189,13 @@ public:
   */
   float fetchAimFrequency();
 
+  /**
+     * @brief Retrieves aim frequency from library
+     * @return Frequency vfd is trying to reach in 0.1Hz
+     * @see update()
+  */
+  uint16_t fetchAimFrequencyDeciHz();
+
   /**
      * @brief Retrieves run frequency from library
      * @return Frequency vfd is running at
@@ -436,6 +1203,13 @@ public:
   */
   float fetchRunFrequency();
 
+  /**
+     * @brief Retrieves run frequency from library
+     * @return Frequency vfd is running at in 0.1Hz
+     * @see update()
+  */
+  uint16_t fetchRunFrequencyDeciHz();
+
   /**
      * @brief Retrieves output current from library
      * @return Output current
@@ -466,9 +1240,12 @@ public:
   uint16_t fetchOperatingCommand();
 
   /**
+     * The id never changes, so update() doesn't read it anymore: the value is the one stored by the
+     * last getCpuID() or successful probe(), 0 if neither was called. Call getCpuID() once in setup()
+     * if the sketch needs it.
      * @brief Retrieves unique id
-     * @return Raw cpu id
-     * @see update()
+     * @return Raw cpu id, 0 if it was never read
+     * @see getCpuID()
   */
   uint16_t fetchCPUId();
 
@@ -500,6 +1277,48 @@ public:
   */
   bool fetchRunning();
 
+  /**
+     * The drive samples its registers between the two: use them to know how old the data is,
+     * or to compute derivatives (es. of run frequency) on the real time between polls.
+     * @brief Retrieves when the last update request was sent
+     * @return micros() the request was sent at
+     * @see fetchResponseTime()
+  */
+  uint32_t fetchRequestTime();
+
+  /**
+     * @brief Retrieves when the last update response was complete
+     * @return micros() the response was complete at
+     * @see fetchRequestTime()
+  */
+  uint32_t fetchResponseTime();
+
+  /**
+     * @brief Average time between update requests
+     * @return period in microseconds, 0 if less than 2 updates
+  */
+  uint32_t getPollPeriod();
+
+  /**
+     * Average deviation of the time between update requests from their average (1/16 weight each,
+     * as RTP interarrival jitter).
+     * @brief Poll period jitter
+     * @return jitter in microseconds
+  */
+  uint32_t getPollJitter();
+
+  /**
+     * @brief Forgets poll period and jitter (es. after changing the poll rate)
+  */
+  void resetPollStats();
+
+  /**
+     * @brief Retrieves if the VFD is running at the frequency it's aiming to
+     * @return TRUE if running and run frequency equals aim frequency
+     * @see update()
+  */
+  bool fetchAtSpeed();
+
 };
 
 